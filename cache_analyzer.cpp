@@ -17,6 +17,26 @@
 #include <iomanip>
 #include <cassert>
 #include <cstdint>
+#include <atomic>
+#include <barrier>
+#include <string>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <functional>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <dirent.h>
+#include <cstddef>
+#include "cache_topology.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
 
 using namespace std;
 using namespace chrono;
@@ -29,6 +49,99 @@ const size_t ITERATIONS = 12'000'000;         // Pointer-chasing loop
 int MEASURE_REPEATS = 16;                     // Number of repeats for median calculation
 volatile uint64_t dummy_sink = 0;             // Prevent compiler from removing loads
 
+// Chrome trace-event recorder (--trace FILE).
+// Phases, measurement points, warm-ups, samples and worker threads become
+// events that chrome://tracing or ui.perfetto.dev can open. Recording is a
+// no-op unless enabled, so probes can instrument freely.
+struct TraceEvent {
+    string name;
+    string cat;
+    char ph;                  // 'X' complete, 'i' instant, 'C' counter, 'M' metadata
+    double ts_us;
+    double dur_us;
+    long tid;
+    string args;              // JSON object body without braces
+};
+
+bool TRACE_ENABLED = false;
+mutex trace_mutex;
+vector<TraceEvent> trace_events;
+const steady_clock::time_point trace_origin = steady_clock::now();
+
+double trace_now_us() {
+    return duration_cast<duration<double, micro>>(steady_clock::now() - trace_origin).count();
+}
+
+long trace_tid() {
+    return (long)syscall(SYS_gettid);
+}
+
+void trace_record(TraceEvent e) {
+    if (!TRACE_ENABLED) return;
+    lock_guard<mutex> lock(trace_mutex);
+    trace_events.push_back(move(e));
+}
+
+void trace_complete(const string& name, const string& cat, double start_us, const string& args = "") {
+    if (!TRACE_ENABLED) return;
+    trace_record({name, cat, 'X', start_us, trace_now_us() - start_us, trace_tid(), args});
+}
+
+void trace_instant(const string& name, const string& cat, const string& args = "") {
+    if (!TRACE_ENABLED) return;
+    trace_record({name, cat, 'i', trace_now_us(), 0, trace_tid(), args});
+}
+
+void trace_counter(const string& name, double value) {
+    if (!TRACE_ENABLED) return;
+    ostringstream a;
+    a << "\"value\":" << value;
+    trace_record({name, "counter", 'C', trace_now_us(), 0, trace_tid(), a.str()});
+}
+
+void trace_thread_name(const string& name) {
+    if (!TRACE_ENABLED) return;
+    trace_record({"thread_name", "", 'M', 0, 0, trace_tid(), "\"name\":\"" + name + "\""});
+}
+
+// Complete event covering the enclosing scope
+struct TraceScope {
+    string name, cat;
+    double start;
+    TraceScope(string name, string cat) : name(move(name)), cat(move(cat)), start(trace_now_us()) {}
+    ~TraceScope() { trace_complete(name, cat, start); }
+};
+
+string json_escape(const string& s) {
+    string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        if ((unsigned char)c < 0x20) continue;
+        out += c;
+    }
+    return out;
+}
+
+bool write_trace(const string& path) {
+    ofstream f(path);
+    if (!f) return false;
+
+    lock_guard<mutex> lock(trace_mutex);
+    f << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    f << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << getpid()
+      << ",\"tid\":0,\"args\":{\"name\":\"cache_analyzer\"}}";
+    for (auto& e : trace_events) {
+        f << ",\n{\"name\":\"" << json_escape(e.name) << "\",\"cat\":\"" << e.cat
+          << "\",\"ph\":\"" << e.ph << "\",\"pid\":" << getpid() << ",\"tid\":" << e.tid
+          << fixed << setprecision(3) << ",\"ts\":" << e.ts_us;
+        if (e.ph == 'X') f << ",\"dur\":" << e.dur_us;
+        if (e.ph == 'i') f << ",\"s\":\"t\"";
+        f << ",\"args\":{" << e.args << "}}";
+    }
+    f << "\n]}\n";
+    return (bool)f;
+}
+
 // Pin process to a single core (reduces noise)
 bool set_process_affinity(int cpu) {
     cpu_set_t mask;
@@ -37,6 +150,385 @@ bool set_process_affinity(int cpu) {
     return sched_setaffinity(0, sizeof(mask), &mask) == 0;
 }
 
+// Pin the calling thread to a single core
+bool pin_thread_to_cpu(int cpu) {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+}
+
+// CPUs in the calling thread's current affinity mask
+vector<int> affinity_cpus() {
+    vector<int> cpus;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        for (int i = 0; i < CPU_SETSIZE; i++)
+            if (CPU_ISSET(i, &mask)) cpus.push_back(i);
+    }
+    if (cpus.empty()) cpus.push_back(0);
+    return cpus;
+}
+
+// Taken before main: runner_place() later pins the process to one CPU
+const vector<int> STARTUP_CPUS = affinity_cpus();
+
+// CPUs the process is allowed to run on
+vector<int> available_cpus() {
+    return STARTUP_CPUS;
+}
+
+// Attribute of the level-`level` data/unified cache from the per-core sysfs
+// view of `cpu`, or "" when the kernel does not expose it
+string sysfs_cache_attr(int level, const string& name, int cpu = 0) {
+    for (int idx = 0; idx < 8; idx++) {
+        string dir = "/sys/devices/system/cpu/cpu" + to_string(cpu) + "/cache/index" + to_string(idx) + "/";
+        ifstream lf(dir + "level"), tf(dir + "type"), vf(dir + name);
+        int lvl = 0;
+        string type, value;
+        if (!(lf >> lvl) || !(tf >> type)) continue;
+        if (lvl != level || type == "Instruction") continue;
+        if (vf >> value) return value;
+    }
+    return "";
+}
+
+// Cache sizes reported by the OS, used to label sweep points.
+// Prefers the per-core sysfs view (glibc may report the whole package on
+// some parts) and falls back to typical values when neither knows them.
+size_t reported_cache_size(int level) {
+    string size = sysfs_cache_attr(level, "size");
+    if (!size.empty()) {
+        size_t v = strtoull(size.c_str(), nullptr, 10);
+        if (size.back() == 'K') v *= 1024;
+        if (size.back() == 'M') v *= 1024 * 1024;
+        if (v > 0) return v;
+    }
+
+    long v = 0;
+    if (level == 1)      v = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    else if (level == 2) v = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    else if (level == 3) v = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (v > 0) return (size_t)v;
+    if (level == 1) return 32 * 1024;
+    if (level == 2) return 1024 * 1024;
+    return 32 * 1024 * 1024;
+}
+
+size_t reported_cache_ways(int level) {
+    size_t v = strtoull(sysfs_cache_attr(level, "ways_of_associativity").c_str(), nullptr, 10);
+    return v > 0 ? v : 8;
+}
+
+size_t reported_line_size() {
+    size_t v = strtoull(sysfs_cache_attr(1, "coherency_line_size").c_str(), nullptr, 10);
+    return v > 0 ? v : 64;
+}
+
+// Smallest level whose capacity holds `bytes`
+const char* level_for_footprint(size_t bytes) {
+    if (bytes <= reported_cache_size(1)) return "L1";
+    if (bytes <= reported_cache_size(2)) return "L2";
+    if (bytes <= reported_cache_size(3)) return "L3";
+    return "DRAM";
+}
+
+// Parse a kernel CPU list such as "0-3,8,10-11"
+vector<int> parse_cpu_list(const string& list) {
+    vector<int> cpus;
+    stringstream ss(list);
+    string part;
+    while (getline(ss, part, ',')) {
+        if (part.empty()) continue;
+        size_t dash = part.find('-');
+        int lo = atoi(part.c_str());
+        int hi = dash == string::npos ? lo : atoi(part.c_str() + dash + 1);
+        for (int c = lo; c <= hi; c++) cpus.push_back(c);
+    }
+    return cpus;
+}
+
+// Core class of `cpu` on hybrid parts ("core" / "atom" PMUs), else "default"
+string cpu_class(int cpu) {
+    for (const char* cls : {"core", "atom"}) {
+        ifstream f(string("/sys/devices/cpu_") + cls + "/cpus");
+        string list;
+        if (!(f >> list)) continue;
+        vector<int> cpus = parse_cpu_list(list);
+        if (find(cpus.begin(), cpus.end(), cpu) != cpus.end()) return cls;
+    }
+    return "default";
+}
+
+// Where a CPU sits. Cores and cache domains are named by their first CPU,
+// unknown ones by the CPU itself, unknown NUMA nodes by 0
+struct CpuPlace {
+    int cpu, package, core, l2, l3, node;
+};
+
+int first_cpu_in(const string& path, int fallback) {
+    ifstream f(path);
+    string list;
+    if (!(f >> list)) return fallback;
+    vector<int> cpus = parse_cpu_list(list);
+    return cpus.empty() ? fallback : cpus[0];
+}
+
+// NUMA node of `cpu` from its nodeN link (node ids may have gaps), 0 without NUMA
+int cpu_node(int cpu) {
+    string dir = "/sys/devices/system/cpu/cpu" + to_string(cpu);
+    DIR* d = opendir(dir.c_str());
+    if (!d) return 0;
+    int node = 0;
+    while (dirent* e = readdir(d))
+        if (sscanf(e->d_name, "node%d", &node) == 1) break;
+    closedir(d);
+    return node;
+}
+
+vector<CpuPlace> cpu_places() {
+    vector<CpuPlace> places;
+    for (int cpu : available_cpus()) {
+        string topo = "/sys/devices/system/cpu/cpu" + to_string(cpu) + "/topology/";
+        CpuPlace p{cpu, 0, cpu, cpu, cpu, 0};
+        ifstream(topo + "physical_package_id") >> p.package;
+        p.core = first_cpu_in(topo + "thread_siblings_list", cpu);
+        for (int level : {2, 3}) {
+            string list = sysfs_cache_attr(level, "shared_cpu_list", cpu);
+            vector<int> shared = parse_cpu_list(list);
+            (level == 2 ? p.l2 : p.l3) = shared.empty() ? cpu : shared[0];
+        }
+        p.node = cpu_node(cpu);
+        places.push_back(p);
+    }
+    return places;
+}
+
+// Kernel-style affinity mask: 32-bit hex groups, most significant first
+string cpu_mask_string(const vector<int>& cpus) {
+    int top = cpus.empty() ? 0 : *max_element(cpus.begin(), cpus.end());
+    vector<uint32_t> words(top / 32 + 1, 0);
+    for (int c : cpus) words[c / 32] |= 1u << (c % 32);
+    ostringstream out;
+    for (size_t i = words.size(); i-- > 0;) {
+        out << hex << setfill('0') << setw(i + 1 == words.size() ? 0 : 8) << words[i];
+        if (i) out << ",";
+    }
+    return out.str();
+}
+
+// CPU list in taskset -c form: "0,2,4"
+string cpu_list_string(const vector<int>& cpus) {
+    ostringstream out;
+    for (size_t i = 0; i < cpus.size(); i++) out << (i ? "," : "") << cpus[i];
+    return out.str();
+}
+
+// OpenMetrics exporter (--metrics FILE).
+// Probes record gauges with labels; the file is rewritten atomically in the
+// node-exporter textfile collector style, at the end of a run and on every
+// soak tick, so cache numbers sit next to the service dashboards.
+struct MetricFamily {
+    string help;
+    map<string, double> samples;   // Rendered label set -> value
+};
+
+map<string, MetricFamily> metric_families;
+string METRICS_PATH;
+string CURRENT_PROBE = "l1";
+int MEASURE_CPU = 0;               // CPU the single-threaded measurements ran on
+
+string metric_label_escape(const string& s) {
+    string out;
+    for (char c : s) {
+        if (c == '\\' || c == '"') out += '\\';
+        if (c == '\n') { out += "\\n"; continue; }
+        out += c;
+    }
+    return out;
+}
+
+// Record one gauge sample; probe and cpu_class labels are added when missing
+void record_metric(const string& name, const string& help,
+                   vector<pair<string, string>> labels, double value) {
+    auto has = [&](const string& k) {
+        for (auto& l : labels) if (l.first == k) return true;
+        return false;
+    };
+    if (!has("probe")) labels.insert(labels.begin(), {"probe", CURRENT_PROBE});
+    if (!has("cpu_class")) labels.push_back({"cpu_class", cpu_class(MEASURE_CPU)});
+
+    string rendered;
+    for (auto& [k, v] : labels)
+        rendered += (rendered.empty() ? "" : ",") + k + "=\"" + metric_label_escape(v) + "\"";
+
+    MetricFamily& f = metric_families["cache_analyzer_" + name];
+    f.help = help;
+    f.samples[rendered] = value;
+}
+
+bool write_metrics() {
+    if (METRICS_PATH.empty()) return true;
+
+    string tmp = METRICS_PATH + ".tmp";
+    {
+        ofstream f(tmp);
+        if (!f) return false;
+        for (auto& [name, fam] : metric_families) {
+            f << "# TYPE " << name << " gauge\n";
+            f << "# HELP " << name << " " << fam.help << "\n";
+            for (auto& [labels, value] : fam.samples)
+                f << name << "{" << labels << "} " << setprecision(9) << value << "\n";
+        }
+        f << "# EOF\n";
+        if (!f) return false;
+    }
+    return rename(tmp.c_str(), METRICS_PATH.c_str()) == 0;
+}
+
+// Checkpoints: every completed measurement point is appended to a results
+// file as one line; with --resume, points already in the file are taken
+// from it instead of being measured again. A fingerprint line starts each
+// run so that points from a different machine or setup are never reused.
+string RESULTS_PATH;
+string CHECKPOINT_RUN;                         // Probe and arguments of this run
+map<string, vector<double>> checkpoint_done;   // Key -> values from earlier runs
+map<string, int> checkpoint_seen;              // Occurrences of a point in this run
+
+// Points may repeat within a run (same label in two phases); number them
+string checkpoint_key(const string& point) {
+    string key = CHECKPOINT_RUN + "\t" + point;
+    return key + "#" + to_string(checkpoint_seen[key]++);
+}
+
+bool checkpoint_lookup(const string& key, vector<double>& values) {
+    auto it = checkpoint_done.find(key);
+    if (it == checkpoint_done.end()) return false;
+    values = it->second;
+    return true;
+}
+
+void checkpoint_store(const string& key, const vector<double>& values) {
+    if (RESULTS_PATH.empty()) return;
+    ofstream f(RESULTS_PATH, ios::app);
+    f << "point\t" << key;
+    for (double v : values) f << "\t" << setprecision(17) << v;
+    f << "\n";
+    f.flush();
+}
+
+// The `count` values of a sweep point: from the results file when resuming,
+// otherwise measured and appended to it
+vector<double> checkpointed(const string& point, size_t count, const function<vector<double>()>& measure) {
+    string key = checkpoint_key(point);
+    vector<double> values;
+    if (checkpoint_lookup(key, values) && values.size() == count) return values;
+    values = measure();
+    checkpoint_store(key, values);
+    return values;
+}
+
+// Fields of a "k=v;k=v" fingerprint that differ between two fingerprints
+string fingerprint_diff(const string& a, const string& b) {
+    auto parse = [](const string& s) {
+        map<string, string> m;
+        stringstream ss(s);
+        string item;
+        while (getline(ss, item, ';')) {
+            size_t eq = item.find('=');
+            if (eq != string::npos) m[item.substr(0, eq)] = item.substr(eq + 1);
+        }
+        return m;
+    };
+    map<string, string> ma = parse(a), mb = parse(b);
+    string out;
+    for (auto& [k, v] : mb)
+        if (ma[k] != v) out += "  " + k + ": '" + ma[k] + "' -> '" + v + "'\n";
+    return out;
+}
+
+// Load points recorded under the same fingerprint and start a new segment;
+// resuming requires the last run in the file to match the current environment
+bool open_results(const string& fingerprint, bool resume) {
+    string last_fp, line;
+    {
+        ifstream in(RESULTS_PATH);
+        string fp;
+        while (getline(in, line)) {
+            if (line.rfind("fingerprint\t", 0) == 0) {
+                fp = line.substr(12);
+                last_fp = fp;
+            } else if (line.rfind("point\t", 0) == 0 && fp == fingerprint && resume) {
+                // point <run> <label#n> <values...>
+                vector<string> cols;
+                stringstream ss(line);
+                string col;
+                while (getline(ss, col, '\t')) cols.push_back(col);
+                if (cols.size() < 4) continue;
+                vector<double> values;
+                for (size_t i = 3; i < cols.size(); i++) values.push_back(atof(cols[i].c_str()));
+                checkpoint_done[cols[1] + "\t" + cols[2]] = values;
+            }
+        }
+    }
+
+    if (resume && !last_fp.empty() && last_fp != fingerprint) {
+        cout << "Environment changed since the results in " << RESULTS_PATH << " were taken:\n"
+             << fingerprint_diff(last_fp, fingerprint) << "Refusing to resume\n";
+        return false;
+    }
+
+    ofstream f(RESULTS_PATH, ios::app);
+    if (!f) {
+        cout << "Could not open results file " << RESULTS_PATH << "\n";
+        return false;
+    }
+    f << "fingerprint\t" << fingerprint << "\n";
+    cout << "Results: " << RESULTS_PATH;
+    if (resume) cout << ", " << checkpoint_done.size() << " points to reuse";
+    cout << "\n";
+    return true;
+}
+
+// Thread counts to sweep: 1, 2, 4, ... plus the number of usable CPUs
+vector<int> thread_count_sweep(int max_threads) {
+    vector<int> counts;
+    for (int t = 1; t < max_threads; t *= 2) counts.push_back(t);
+    counts.push_back(max_threads);
+    return counts;
+}
+
+// Run `n` threads pinned round-robin over `cpus` and release them together.
+// Returns wall time in seconds from the release to the last join.
+template<typename F>
+double run_pinned_threads(int n, const vector<int>& cpus, F body) {
+    atomic<int> ready{0};
+    atomic<bool> go{false};
+    vector<thread> workers;
+    workers.reserve(n);
+
+    for (int t = 0; t < n; t++) {
+        workers.emplace_back([&, t] {
+            int cpu = cpus[t % cpus.size()];
+            pin_thread_to_cpu(cpu);
+            trace_thread_name("worker " + to_string(t) + " (cpu " + to_string(cpu) + ")");
+            ready.fetch_add(1);
+            while (!go.load(memory_order_acquire)) this_thread::yield();
+            TraceScope scope("worker " + to_string(t), "thread");
+            body(t);
+        });
+    }
+
+    while (ready.load() < n) this_thread::yield();
+    auto t0 = steady_clock::now();
+    go.store(true, memory_order_release);
+    for (auto& w : workers) w.join();
+    auto t1 = steady_clock::now();
+
+    return duration_cast<duration<double>>(t1 - t0).count();
+}
+
 // Avoid unwanted compiler optimizations
 template<typename T>
 inline void blackhole(T v) {
@@ -48,6 +540,54 @@ inline void blackhole_ptr(T* p) {
     asm volatile("" : : "r"(p) : "memory");
 }
 
+// Serialized cycle counter for timing a handful of instructions.
+// rdtscp waits for earlier loads; the lfence keeps later ones from starting.
+inline uint64_t read_timestamp() {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned aux;
+    uint64_t t = __rdtscp(&aux);
+    _mm_lfence();
+    return t;
+#else
+    return (uint64_t)steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// CPU vendor string from CPUID ("GenuineIntel", "AuthenticAMD", ...)
+string cpu_vendor() {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned a, b, c, d;
+    if (!__get_cpuid(0, &a, &b, &c, &d)) return "";
+    char v[13];
+    memcpy(v, &b, 4);
+    memcpy(v + 4, &d, 4);
+    memcpy(v + 8, &c, 4);
+    v[12] = 0;
+    return v;
+#else
+    return "";
+#endif
+}
+
+// Per-thread hardware counter, user space only.
+// Returns -1 when the event is unsupported or perf_event_paranoid forbids it.
+int open_perf_counter(uint32_t type, uint64_t config) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+uint64_t read_perf_counter(int fd) {
+    uint64_t v = 0;
+    if (fd < 0 || read(fd, &v, sizeof(v)) != sizeof(v)) return 0;
+    return v;
+}
+
 // Allocate aligned memory for pointer chains
 void* allocate_aligned(size_t align, size_t size) {
     void* p = nullptr;
@@ -77,15 +617,15 @@ void warmup_chain(void** start, size_t count) {
     blackhole_ptr((void*)p);
 }
 
-// Pointer-chase measurement
-double measure_chain_latency(void** start, size_t count) {
+// Pointer-chase measurement over `iterations` hops
+double measure_chain_latency(void** start, size_t count, size_t iterations) {
     // Small warm-up to stabilize line fills
     warmup_chain(start, min<size_t>(count, 8192));
 
     const void* p = start;
     auto t0 = steady_clock::now();
 
-    for (size_t i = 0; i < ITERATIONS; i++) {
+    for (size_t i = 0; i < iterations; i++) {
         p = *(void* const*)p;
 
         // Occasional barrier to stop the optimizer
@@ -98,7 +638,11 @@ double measure_chain_latency(void** start, size_t count) {
     dummy_sink = dummy_sink ^ (uint64_t)(uintptr_t)p;
 
     double ns = duration_cast<duration<double, nano>>(t1 - t0).count();
-    return ns / ITERATIONS;
+    return ns / iterations;
+}
+
+double measure_chain_latency(void** start, size_t count) {
+    return measure_chain_latency(start, count, ITERATIONS);
 }
 
 double median_of_vector(vector<double> v) {
@@ -109,17 +653,257 @@ double median_of_vector(vector<double> v) {
     return (v[n/2 - 1] + v[n/2]) * 0.5;
 }
 
+// Shared measurement runner.
+// Probes describe a pointer-chasing access pattern; the runner owns CPU
+// placement, allocation, calibration, warm-up, repeats, sample filtering,
+// statistics and reporting, so every probe gets the same treatment.
+
+// Cycle laid out by a pattern: where to start and how many hops it has
+struct ChainLayout {
+    void** start;
+    size_t count;
+};
+
+struct ChainPattern {
+    string label;
+    size_t bytes;                                       // Memory the pattern needs
+    function<ChainLayout(char* mem, size_t bytes)> build;
+    bool sparse = false;      // MAP_NORESERVE reservation, only built pages get touched
+    size_t alias_bytes = 0;   // memfd pool mapped repeatedly over the range (0: off)
+    int warmups = 1;          // Full passes over the cycle before measuring
+};
+
+struct RunnerCalibration {
+    double clock_ns;          // One steady_clock::now() call
+    double loop_ns;           // One chase-loop iteration without the load
+    double sample_ns;         // Target duration of one sample
+};
+
+struct SampleStats {
+    double median = 0, min = 0, max = 0;
+    size_t kept = 0, discarded = 0;
+    size_t iterations = 0;    // Hops per sample chosen by the budget
+    size_t bytes = 0;         // Footprint of the pattern
+};
+
+int RUNNER_CPU = -1;                      // CPU for measurements (-1: first available)
+const double RUNNER_DISCARD_RATIO = 1.20; // Drop samples this far above the median
+const size_t RUNNER_MIN_ITERATIONS = 100'000;
+
+bool runner_placed = false;
+
+// Pin the measuring thread once per process
+void runner_place() {
+    if (runner_placed) return;
+    runner_placed = true;
+    int cpu = RUNNER_CPU >= 0 ? RUNNER_CPU : available_cpus()[0];
+    set_process_affinity(cpu);
+    MEASURE_CPU = cpu;
+}
+
+// Undo runner_place(): back to the startup mask, so the next probe sees all
+// CPUs and pins again if it measures
+void runner_release() {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (int cpu : STARTUP_CPUS) CPU_SET(cpu, &mask);
+    sched_setaffinity(0, sizeof(mask), &mask);
+    runner_placed = false;
+}
+
+// Same loop as measure_chain_latency with the load removed
+double measure_loop_overhead(size_t iterations) {
+    const void* p = &p;
+    auto t0 = steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        if ((i & 4095) == 0) asm volatile("" : : "r"(i) : "memory");
+        asm volatile("" : "+r"(p));
+    }
+    auto t1 = steady_clock::now();
+    blackhole_ptr((void*)p);
+    return duration_cast<duration<double, nano>>(t1 - t0).count() / iterations;
+}
+
+const RunnerCalibration& runner_calibration() {
+    static const RunnerCalibration cal = [] {
+        runner_place();
+        TraceScope scope("calibration", "phase");
+        RunnerCalibration c;
+
+        c.clock_ns = 1e9;
+        for (int i = 0; i < 10000; i++) {
+            auto a = steady_clock::now();
+            auto b = steady_clock::now();
+            c.clock_ns = min(c.clock_ns, duration_cast<duration<double, nano>>(b - a).count());
+        }
+
+        vector<double> loops;
+        for (int r = 0; r < 5; r++) loops.push_back(measure_loop_overhead(1'000'000));
+        c.loop_ns = median_of_vector(loops);
+
+        // Long enough that clock reads are noise, short enough to repeat
+        c.sample_ns = max(20e6, 10000 * c.clock_ns);
+        return c;
+    }();
+    return cal;
+}
+
+void print_runner_calibration() {
+    const RunnerCalibration& c = runner_calibration();
+    cout << "Runner: clock " << fixed << setprecision(1) << c.clock_ns << " ns, loop "
+         << setprecision(3) << c.loop_ns << " ns/iter, " << setprecision(0)
+         << c.sample_ns / 1e6 << " ms per sample\n";
+}
+
+// Median of the samples within RUNNER_DISCARD_RATIO of the raw median
+SampleStats summarize_samples(const vector<double>& samples) {
+    SampleStats s;
+    if (samples.empty()) return s;
+
+    double raw = median_of_vector(samples);
+    vector<double> kept;
+    for (double v : samples)
+        if (v <= raw * RUNNER_DISCARD_RATIO) kept.push_back(v);
+
+    s.kept = kept.size();
+    s.discarded = samples.size() - kept.size();
+    s.median = median_of_vector(kept);
+    s.min = *min_element(kept.begin(), kept.end());
+    s.max = *max_element(kept.begin(), kept.end());
+    return s;
+}
+
+// Warm up and time an already built chain, with the runner's iteration budget
+SampleStats sample_chain(const ChainLayout& chain, int warmups, int repeats = MEASURE_REPEATS) {
+    const RunnerCalibration& cal = runner_calibration();
+
+    double warm_start = trace_now_us();
+    for (int w = 0; w < warmups; w++) warmup_chain(chain.start, chain.count);
+    trace_complete("warm-up", "warmup", warm_start);
+
+    // Iteration budget: a short pilot scaled to the target sample duration
+    double pilot = measure_chain_latency(chain.start, chain.count, RUNNER_MIN_ITERATIONS);
+    size_t iters = (size_t)(cal.sample_ns / max(pilot, 0.01));
+    iters = min(max(iters, RUNNER_MIN_ITERATIONS), ITERATIONS);
+
+    vector<double> samples, starts, ends;
+    for (int r = 0; r < repeats; r++) {
+        starts.push_back(trace_now_us());
+        samples.push_back(measure_chain_latency(chain.start, chain.count, iters));
+        ends.push_back(trace_now_us());
+    }
+
+    SampleStats s = summarize_samples(samples);
+    s.iterations = iters;
+
+    if (TRACE_ENABLED) {
+        double raw = median_of_vector(samples);
+        for (size_t r = 0; r < samples.size(); r++) {
+            bool dropped = samples[r] > raw * RUNNER_DISCARD_RATIO;
+            ostringstream a;
+            a << "\"ns\":" << samples[r] << ",\"iterations\":" << iters
+              << ",\"discarded\":" << (dropped ? "true" : "false");
+            trace_record({dropped ? "discarded sample" : "sample", "sample", 'X',
+                          starts[r], ends[r] - starts[r], trace_tid(), a.str()});
+        }
+    }
+    return s;
+}
+
+// Reserve `bytes` of address space backed by one memfd pool of `pool` bytes
+// mapped over and over, so the resident size stays at the pool size
+char* map_aliased(size_t bytes, size_t pool) {
+    int fd = memfd_create("cache_analyzer_alias", 0);
+    if (fd < 0) return nullptr;
+    if (ftruncate(fd, pool) != 0) {
+        close(fd);
+        return nullptr;
+    }
+    char* base = (char*)mmap(nullptr, bytes, PROT_NONE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return nullptr;
+    }
+    for (size_t off = 0; off < bytes; off += pool) {
+        if (mmap(base + off, min(pool, bytes - off), PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            munmap(base, bytes);
+            close(fd);
+            return nullptr;
+        }
+    }
+    close(fd);
+    return base;
+}
+
+// Allocate, build, warm up and time a pattern; kept == 0 means it could not run
+SampleStats measure_pattern(const ChainPattern& pat, int repeats = MEASURE_REPEATS) {
+    string key = checkpoint_key(pat.label + " (" + to_string(pat.bytes) + " B)");
+    vector<double> saved;
+    if (checkpoint_lookup(key, saved) && saved.size() == 7) {
+        trace_instant("resumed point", "point", "\"point\":\"" + json_escape(pat.label) + "\"");
+        SampleStats s;
+        s.median = saved[0]; s.min = saved[1]; s.max = saved[2];
+        s.kept = (size_t)saved[3]; s.discarded = (size_t)saved[4];
+        s.iterations = (size_t)saved[5]; s.bytes = (size_t)saved[6];
+        return s;
+    }
+
+    size_t bytes = max(pat.bytes, PAGE_SIZE);
+
+    char* mem;
+    if (pat.alias_bytes) {
+        mem = map_aliased(bytes, pat.alias_bytes);
+        if (!mem) return {};
+    } else if (pat.sparse) {
+        mem = (char*)mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mem == MAP_FAILED) return {};
+        madvise(mem, bytes, MADV_NOHUGEPAGE);
+    } else {
+        mem = (char*)allocate_aligned(PAGE_SIZE, bytes);
+        if (!mem) return {};
+        memset(mem, 0, bytes);                  // Fault pages in outside the timing
+    }
+
+    TraceScope point_scope(pat.label.empty() ? "point" : pat.label, "point");
+
+    ChainLayout chain = pat.build(mem, pat.bytes);
+    SampleStats s = sample_chain(chain, pat.warmups, repeats);
+    s.bytes = pat.bytes;
+
+    if (pat.sparse || pat.alias_bytes) munmap(mem, bytes);
+    else free(mem);
+
+    if (s.kept)
+        checkpoint_store(key, {s.median, s.min, s.max, (double)s.kept, (double)s.discarded,
+                               (double)s.iterations, (double)s.bytes});
+    return s;
+}
+
+// One line per measurement point, the same for every probe
+void report_point(const string& label, const SampleStats& s) {
+    cout << setw(24) << label << " -> " << fixed << setprecision(6) << s.median << " ns"
+         << "  [" << setprecision(3) << s.min << " .. " << s.max << "]";
+    if (s.discarded) cout << "  " << s.discarded << "/" << s.kept + s.discarded << " discarded";
+    if (s.median < 1.5 * runner_calibration().loop_ns) cout << "  (near loop floor)";
+    cout << endl;
+
+    record_metric("point_latency_ns", "Median pointer-chase latency of a measurement point",
+                  {{"point", label}, {"level", level_for_footprint(s.bytes)}}, s.median);
+}
+
 // Line size detection: stride-based pointer chasing
 // Looks for the stride at which latency jumps noticeably.
 size_t detect_line_size() {
+    TraceScope scope("detect_line_size", "phase");
     cout << "Detecting L1 line size..." << endl;
 
     vector<size_t> stride_bytes = {4, 8, 16, 32, 64, 128, 256};
     vector<double> times;
 
     size_t ptr_count = 256 * 1024;
-    void **arr = (void**)allocate_aligned(PAGE_SIZE, ptr_count * sizeof(void*));
-    create_random_chain(arr, ptr_count);
 
     for (size_t sb : stride_bytes) {
         size_t step = max<size_t>(1, sb / sizeof(void*));
@@ -127,23 +911,19 @@ size_t detect_line_size() {
 
         if (count < 16) { times.push_back(0); continue; }
 
-        // Build stride-based cycle
-        for (size_t i = 0; i < count; i++)
-            arr[i * step] = &arr[((i + 1) % count) * step];
-
-        // Warm-up attempts
-        for (int w = 0; w < 5; w++)
-            warmup_chain(arr, min<size_t>(count, 32768));
+        // Stride-based cycle
+        ChainPattern pat{"Stride " + to_string(sb) + " bytes", ptr_count * sizeof(void*),
+                         [&](char* mem, size_t) {
+            void** arr = (void**)mem;
+            for (size_t i = 0; i < count; i++)
+                arr[i * step] = &arr[((i + 1) % count) * step];
+            return ChainLayout{arr, count};
+        }};
+        pat.warmups = 5;
 
-        vector<double> reps;
-        for (int r = 0; r < MEASURE_REPEATS; r++)
-            reps.push_back(measure_chain_latency(arr, count));
-
-        double med = median_of_vector(reps);
-        cout << "Stride " << setw(4) << sb << " bytes -> "
-             << fixed << setprecision(6) << med << " ns\n";
-
-        times.push_back(med);
+        SampleStats s = measure_pattern(pat);
+        report_point(pat.label, s);
+        times.push_back(s.median);
     }
 
     // Look for relative jumps
@@ -175,14 +955,13 @@ size_t detect_line_size() {
     }
 
     cout << "--> chosen line size = " << chosen << " bytes\n\n";
-
-    free(arr);
     return chosen;
 }
 
 // L1 size detection using increasing working-set sizes.
 // Latency increases when the working set no longer fits L1.
 size_t detect_l1_size(size_t line_size) {
+    TraceScope scope("detect_l1_size", "phase");
     cout << "Detecting L1 cache size..." << endl;
 
     vector<size_t> sizes_kb = {
@@ -192,22 +971,15 @@ size_t detect_l1_size(size_t line_size) {
     vector<double> times;
 
     for (size_t kb : sizes_kb) {
-        size_t bytes = kb * 1024;
-        size_t count = max<size_t>(4, bytes / sizeof(void*));
-
-        void** arr = (void**)allocate_aligned(PAGE_SIZE, max(bytes, PAGE_SIZE));
-        create_random_chain(arr, count);
+        ChainPattern pat{to_string(kb) + " KB", kb * 1024, [](char* mem, size_t bytes) {
+            size_t count = max<size_t>(4, bytes / sizeof(void*));
+            create_random_chain((void**)mem, count);
+            return ChainLayout{(void**)mem, count};
+        }};
 
-        vector<double> res;
-        res.reserve(MEASURE_REPEATS);
-        for (int r = 0; r < MEASURE_REPEATS; r++)
-            res.push_back(measure_chain_latency(arr, count));
-
-        double med = median_of_vector(res);
-        cout << kb << " KB: " << fixed << setprecision(6) << med << " ns" << endl;
-
-        times.push_back(med);
-        free(arr);
+        SampleStats s = measure_pattern(pat);
+        report_point(pat.label, s);
+        times.push_back(s.median);
     }
 
     // Look for the first noticeable jump
@@ -227,6 +999,7 @@ size_t detect_l1_size(size_t line_size) {
 // Builds conflict sets mapped to the same index by spacing
 // elements one cache-size apart. Latency rises after #ways+1.
 int detect_associativity(size_t line_size, size_t l1_size) {
+    TraceScope scope("detect_associativity", "phase");
     cout << "Detecting associativity..." << endl;
 
     vector<double> times;
@@ -237,39 +1010,35 @@ int detect_associativity(size_t line_size, size_t l1_size) {
 
     for (int conflicts = 1; conflicts <= max_conflicts; ++conflicts) {
         size_t needed = (size_t)conflicts * stride_ptrs + 64;
-        vector<void*> buf(needed, nullptr);
-        vector<size_t> idx(conflicts);
-        for (int i = 0; i < conflicts; ++i) idx[i] = i * stride_ptrs;
 
-        // Randomize access order among conflict positions
-        vector<int> perm(conflicts);
-        for (int i = 0; i < conflicts; ++i) perm[i] = i;
-        mt19937_64 rng((uint64_t)123456 + conflicts);
-        for (int i = conflicts - 1; i > 0; --i)
-            swap(perm[i], perm[rng() % (i + 1)]);
+        ChainPattern pat{to_string(conflicts) + " conflicts", needed * sizeof(void*),
+                         [&](char* mem, size_t) {
+            void** buf = (void**)mem;
+            vector<size_t> idx(conflicts);
+            for (int i = 0; i < conflicts; ++i) idx[i] = i * stride_ptrs;
 
-        // Build the cycle over the conflict points
-        for (int i = 0; i < conflicts; ++i)
-            buf[idx[perm[i]]] = &buf[idx[perm[(i + 1) % conflicts]]];
+            // Randomize access order among conflict positions
+            vector<int> perm(conflicts);
+            for (int i = 0; i < conflicts; ++i) perm[i] = i;
+            mt19937_64 rng((uint64_t)123456 + conflicts);
+            for (int i = conflicts - 1; i > 0; --i)
+                swap(perm[i], perm[rng() % (i + 1)]);
 
-        // Fill remaining entries so everything forms a valid cycle
-        for (size_t i = 0; i < needed; ++i)
-            if (!buf[i]) buf[i] = &buf[(i + 1) % needed];
+            // Build the cycle over the conflict points
+            for (int i = 0; i < conflicts; ++i)
+                buf[idx[perm[i]]] = &buf[idx[perm[(i + 1) % conflicts]]];
 
-        // Warm-up
-        warmup_chain((void**)&buf[idx[0]], min<size_t>(needed, 65536));
+            // Fill remaining entries so everything forms a valid cycle
+            for (size_t i = 0; i < needed; ++i)
+                if (!buf[i]) buf[i] = &buf[(i + 1) % needed];
 
-        // Measurement
-        vector<double> reps;
-        reps.reserve(MEASURE_REPEATS);
-        for (int r = 0; r < MEASURE_REPEATS; ++r)
-            reps.push_back(measure_chain_latency((void**)&buf[idx[0]], conflicts));
+            return ChainLayout{&buf[idx[0]], (size_t)conflicts};
+        }};
+        pat.warmups = 64;
 
-        double med = median_of_vector(reps);
-        times.push_back(med);
-
-        cout << setw(2) << conflicts << " conflicts -> "
-             << fixed << setprecision(6) << med << " ns" << endl;
+        SampleStats s = measure_pattern(pat);
+        report_point(pat.label, s);
+        times.push_back(s.median);
     }
 
     // Use the first few points as the baseline
@@ -298,34 +1067,3531 @@ int detect_associativity(size_t line_size, size_t l1_size) {
     return 8;
 }
 
-int main() {
-    ios::sync_with_stdio(false);
-    cin.tie(nullptr);
+// Histogram (scatter-update) throughput by bin count.
+// Compares a shared histogram, per-thread private histograms with a merge
+// and private multi-copy bins, where consecutive keys go to different
+// copies so repeated hits on one bin do not wait on store forwarding.
+enum class HistStrategy { Shared, Private, MultiCopy };
 
-    cout << "=== L1 Cache Detection ===\n";
+const int HIST_COPIES = 4;
+const size_t HIST_KEYS = 1 << 22;
+const size_t HIST_MAX_BYTES = 1024ull * 1024 * 1024; // Skip configs above this
 
-    // Fix CPU to reduce jitter
-    set_process_affinity(0);
+size_t histogram_bytes(HistStrategy s, size_t bins, int threads) {
+    size_t per_copy = bins * sizeof(uint32_t);
+    if (s == HistStrategy::Shared) return per_copy;
+    size_t copies = (s == HistStrategy::MultiCopy) ? HIST_COPIES : 1;
+    return per_copy * copies * threads + per_copy;
+}
 
-    // Initial warm-up of memory subsystem
-    void* buf = allocate_aligned(PAGE_SIZE, BUFFER_SIZE);
-    memset(buf, 0xAA, BUFFER_SIZE);
-    blackhole_ptr(buf);
+// One timed histogram build; returns updates per second (0 if skipped)
+double histogram_run(HistStrategy s, const vector<uint32_t>& keys, size_t bins,
+                     int threads, const vector<int>& cpus) {
+    if (histogram_bytes(s, bins, threads) > HIST_MAX_BYTES) return 0;
 
-    size_t line = detect_line_size();
-    size_t l1_raw = detect_l1_size(line);
-    int assoc = detect_associativity(line, l1_raw);
+    size_t copies = (s == HistStrategy::MultiCopy) ? HIST_COPIES : 1;
+    size_t mask = bins - 1;
+    size_t chunk = keys.size() / threads;
 
-    // Compute number of sets
-    size_t unit = line * assoc;
-    size_t sets = (l1_raw + unit/2) / unit;
-    size_t l1_corrected = sets * unit;
+    vector<uint32_t> result(bins, 0);
+    vector<vector<uint32_t>> priv;
+    if (s != HistStrategy::Shared)
+        priv.assign(threads, vector<uint32_t>(bins * copies, 0));
 
-    dummy_sink = dummy_sink ^ (int)line ^ (int)l1_corrected ^ assoc;
+    barrier sync(threads);
 
-    cout << "\n===== FINAL RESULTS =====\n";
-    cout << "Line size: " << line << " bytes\n";
-    cout << "L1 size:   " << l1_corrected/1024 << " KB\n";
-    cout << "Assoc:     " << assoc << " ways\n";
-    cout << "Dummy:     " << dummy_sink << "\n";
+    double secs = run_pinned_threads(threads, cpus, [&](int t) {
+        const uint32_t* k = keys.data() + t * chunk;
+
+        if (s == HistStrategy::Shared) {
+            uint32_t* h = result.data();
+            if (threads == 1) {
+                for (size_t i = 0; i < chunk; i++) h[k[i] & mask]++;
+            } else {
+                for (size_t i = 0; i < chunk; i++)
+                    atomic_ref<uint32_t>(h[k[i] & mask]).fetch_add(1, memory_order_relaxed);
+            }
+            return;
+        }
+
+        uint32_t* h = priv[t].data();
+        if (s == HistStrategy::Private) {
+            for (size_t i = 0; i < chunk; i++) h[k[i] & mask]++;
+        } else {
+            for (size_t i = 0; i < chunk; i++)
+                h[(k[i] & mask) * HIST_COPIES + (i & (HIST_COPIES - 1))]++;
+        }
+
+        // Merge: every thread reduces its own slice of the bins
+        sync.arrive_and_wait();
+        size_t lo = bins * t / threads, hi = bins * (t + 1) / threads;
+        for (size_t b = lo; b < hi; b++) {
+            uint32_t sum = 0;
+            for (int p = 0; p < threads; p++)
+                for (size_t c = 0; c < copies; c++)
+                    sum += priv[p][b * copies + c];
+            result[b] = sum;
+        }
+    });
+
+    uint64_t total = 0;
+    for (uint32_t v : result) total += v;
+    if (total != chunk * threads)
+        cout << "  warning: histogram lost updates (" << total << ")\n";
+    dummy_sink = dummy_sink ^ total;
+
+    return (double)(chunk * threads) / secs;
+}
+
+int run_histogram_probe(int max_threads) {
+    cout << "=== Histogram scatter-update throughput ===\n";
+
+    vector<int> cpus = available_cpus();
+    if (max_threads <= 0) max_threads = (int)cpus.size();
+
+    vector<uint32_t> keys(HIST_KEYS);
+    mt19937_64 rng(1234567);
+    for (auto& k : keys) k = (uint32_t)rng();
+
+    const int repeats = 5;
+    const char* names[] = {"shared", "private", "multicopy"};
+    HistStrategy strategies[] = {
+        HistStrategy::Shared, HistStrategy::Private, HistStrategy::MultiCopy
+    };
+
+    cout << "    Bins  Footprint Level Thr      shared     private   multicopy  best\n";
+    cout << "                                  (Mupd/s)\n";
+
+    for (size_t bins = 16; bins <= (1u << 24); bins *= 4) {
+        size_t footprint = bins * sizeof(uint32_t);
+
+        for (int threads : thread_count_sweep(max_threads)) {
+            double rate[3];
+            for (int s = 0; s < 3; s++) {
+                string point = string(names[s]) + " bins=" + to_string(bins) + " threads=" + to_string(threads);
+                rate[s] = checkpointed(point, 1, [&] {
+                    vector<double> reps;
+                    for (int r = 0; r < repeats; r++)
+                        reps.push_back(histogram_run(strategies[s], keys, bins, threads, cpus));
+                    return vector<double>{median_of_vector(reps)};
+                })[0];
+            }
+
+            int best = (int)(max_element(rate, rate + 3) - rate);
+
+            cout << setw(8) << bins << " "
+                 << setw(8) << footprint / 1024 << "K "
+                 << setw(5) << level_for_footprint(footprint) << " "
+                 << setw(3) << threads;
+            for (int s = 0; s < 3; s++) {
+                if (rate[s] == 0) cout << setw(12) << "skip";
+                else cout << setw(12) << fixed << setprecision(1) << rate[s] / 1e6;
+            }
+            cout << "  " << names[best] << "\n";
+        }
+    }
+
+    cout << "Dummy: " << dummy_sink << "\n";
+    return 0;
+}
+
+// Bloom filter probe cost by filter size.
+// Classic filters touch k random lines per lookup, line-blocked filters
+// keep all k bits in one cache line and register-blocked filters keep
+// them in one 64-bit word, trading false-positive rate for fewer misses.
+enum class BloomKind { Classic, LineBlocked, RegisterBlocked };
+
+const int BLOOM_K = 7;
+const size_t BLOOM_BITS_PER_KEY = 10;
+const size_t BLOOM_QUERIES = 1 << 20;
+
+// 64-bit finalizer (splitmix64)
+inline uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+struct BloomFilter {
+    BloomKind kind;
+    vector<uint64_t> words;
+    size_t block_words;   // Words per block (1 for register-blocked)
+    size_t block_mask;    // Number of blocks - 1 (bits - 1 for classic)
+
+    BloomFilter(BloomKind kind, size_t bytes, size_t line_size) : kind(kind) {
+        words.assign(bytes / sizeof(uint64_t), 0);
+        if (kind == BloomKind::Classic) {
+            block_words = 0;
+            block_mask = bytes * 8 - 1;
+        } else {
+            block_words = kind == BloomKind::LineBlocked ? line_size / sizeof(uint64_t) : 1;
+            block_mask = words.size() / block_words - 1;
+        }
+    }
+
+    void insert(uint64_t key) {
+        uint64_t h1 = mix64(key), h2 = mix64(h1) | 1;
+        if (kind == BloomKind::Classic) {
+            for (int i = 0; i < BLOOM_K; i++) {
+                size_t bit = (h1 + i * h2) & block_mask;
+                words[bit >> 6] |= 1ull << (bit & 63);
+            }
+        } else if (kind == BloomKind::LineBlocked) {
+            uint64_t* block = &words[(h1 & block_mask) * block_words];
+            size_t bits_mask = block_words * 64 - 1;
+            for (int i = 0; i < BLOOM_K; i++) {
+                size_t bit = ((h1 >> 32) + i * h2) & bits_mask;
+                block[bit >> 6] |= 1ull << (bit & 63);
+            }
+        } else {
+            words[h1 & block_mask] |= register_mask(h2);
+        }
+    }
+
+    bool contains(uint64_t key) const {
+        uint64_t h1 = mix64(key), h2 = mix64(h1) | 1;
+        if (kind == BloomKind::Classic) {
+            for (int i = 0; i < BLOOM_K; i++) {
+                size_t bit = (h1 + i * h2) & block_mask;
+                if (!(words[bit >> 6] & (1ull << (bit & 63)))) return false;
+            }
+            return true;
+        } else if (kind == BloomKind::LineBlocked) {
+            const uint64_t* block = &words[(h1 & block_mask) * block_words];
+            size_t bits_mask = block_words * 64 - 1;
+            for (int i = 0; i < BLOOM_K; i++) {
+                size_t bit = ((h1 >> 32) + i * h2) & bits_mask;
+                if (!(block[bit >> 6] & (1ull << (bit & 63)))) return false;
+            }
+            return true;
+        }
+        uint64_t m = register_mask(h2);
+        return (words[h1 & block_mask] & m) == m;
+    }
+
+    static uint64_t register_mask(uint64_t h) {
+        uint64_t m = 0;
+        for (int i = 0; i < BLOOM_K; i++) m |= 1ull << ((h >> (i * 6)) & 63);
+        return m;
+    }
+};
+
+int run_bloom_probe(size_t line_size) {
+    cout << "=== Bloom filter probe cost ===\n";
+
+    if (line_size == 0) line_size = detect_line_size();
+    line_size = max<size_t>(line_size, sizeof(uint64_t));
+
+    // Filter sizes: powers of two from L1 up to 2x the LLC
+    size_t lo = 1, hi = 2 * reported_cache_size(3);
+    while (lo * 2 <= reported_cache_size(1)) lo *= 2;
+
+    // Negative queries: keys drawn from a range disjoint from the inserts
+    vector<uint64_t> queries(BLOOM_QUERIES);
+    for (size_t i = 0; i < BLOOM_QUERIES; i++) queries[i] = (1ull << 63) | i;
+
+    const int repeats = 3;
+    const char* names[] = {"classic", "line", "register"};
+    BloomKind kinds[] = {BloomKind::Classic, BloomKind::LineBlocked, BloomKind::RegisterBlocked};
+
+    cout << "Line size for blocking: " << line_size << " bytes, k = " << BLOOM_K
+         << ", " << BLOOM_BITS_PER_KEY << " bits/key\n";
+    cout << "    Size Level   classic Mq/s   FPR%     line Mq/s   FPR%   register Mq/s   FPR%  fastest\n";
+
+    for (size_t bytes = lo; bytes <= hi; bytes *= 2) {
+        size_t keys = bytes * 8 / BLOOM_BITS_PER_KEY;
+        double rate[3], fpr[3];
+
+        for (int v = 0; v < 3; v++) {
+            string point = string(names[v]) + " bytes=" + to_string(bytes) + " line=" + to_string(line_size);
+            vector<double> res = checkpointed(point, 2, [&] {
+                BloomFilter f(kinds[v], bytes, line_size);
+                for (size_t i = 0; i < keys; i++) f.insert(i);
+
+                size_t hits = 0;
+                vector<double> reps;
+                for (int r = 0; r < repeats; r++) {
+                    hits = 0;
+                    auto t0 = steady_clock::now();
+                    for (uint64_t q : queries) hits += f.contains(q);
+                    auto t1 = steady_clock::now();
+                    reps.push_back(BLOOM_QUERIES / duration_cast<duration<double>>(t1 - t0).count());
+                }
+                dummy_sink = dummy_sink ^ hits;
+                return vector<double>{median_of_vector(reps), 100.0 * hits / BLOOM_QUERIES};
+            });
+            rate[v] = res[0];
+            fpr[v] = res[1];
+        }
+
+        int best = (int)(max_element(rate, rate + 3) - rate);
+
+        cout << setw(7) << bytes / 1024 << "K " << setw(5) << level_for_footprint(bytes);
+        for (int v = 0; v < 3; v++)
+            cout << setw(15) << fixed << setprecision(1) << rate[v] / 1e6
+                 << setw(7) << setprecision(3) << fpr[v];
+        cout << "  " << names[best] << endl;
+    }
+
+    cout << "Dummy: " << dummy_sink << "\n";
+    return 0;
+}
+
+// Physical address of a resident page via /proc/self/pagemap.
+// Returns 0 when the PFN is hidden (no CAP_SYS_ADMIN) or the page is absent.
+uint64_t virt_to_phys(const void* p) {
+    static int fd = open("/proc/self/pagemap", O_RDONLY);
+    if (fd < 0) return 0;
+
+    uint64_t va = (uint64_t)(uintptr_t)p, entry = 0;
+    off_t off = (off_t)(va / PAGE_SIZE) * sizeof(entry);
+    if (pread(fd, &entry, sizeof(entry), off) != sizeof(entry)) return 0;
+    if (!(entry & (1ull << 63))) return 0;
+
+    uint64_t pfn = entry & ((1ull << 55) - 1);
+    if (pfn == 0) return 0;
+    return pfn * PAGE_SIZE + va % PAGE_SIZE;
+}
+
+// Per-line latency map.
+// Times every hop of a warm random chain (one pointer per line) over many
+// passes and attributes each sample to the line it loaded. Lines and sets
+// that are slow in most passes point at degraded ways or hot slices; the
+// slice hash is not public, so LLC lines are grouped by latency instead.
+int run_linemap_probe(size_t ws_kb) {
+    cout << "=== Per-line latency map ===\n";
+
+    size_t line = reported_line_size();
+    size_t ws = ws_kb ? ws_kb * 1024 : reported_cache_size(1);
+    ws = max(ws, line);    // At least one line, or the chain below is empty
+    size_t lines = ws / line;
+    const int passes = 200;
+
+    // Cache level the working set lands in, and its set geometry
+    int level = 1;
+    while (level < 3 && ws > reported_cache_size(level)) level++;
+    size_t ways = reported_cache_ways(level);
+    size_t sets = max<size_t>(1, reported_cache_size(level) / (line * ways));
+
+    char* base = (char*)allocate_aligned(PAGE_SIZE, ws);
+    memset(base, 0, ws);
+
+    vector<size_t> order(lines);
+    for (size_t i = 0; i < lines; i++) order[i] = i;
+    mt19937_64 rng(1234567);
+    shuffle(order.begin(), order.end(), rng);
+    for (size_t i = 0; i < lines; i++)
+        *(void**)(base + order[i] * line) = base + order[(i + 1) % lines] * line;
+
+    // Timer overhead: minimum of back-to-back reads
+    uint64_t overhead = UINT64_MAX;
+    for (int i = 0; i < 10000; i++) {
+        uint64_t t0 = read_timestamp();
+        uint64_t t1 = read_timestamp();
+        overhead = min(overhead, t1 - t0);
+    }
+
+    vector<uint32_t> samples((size_t)passes * lines);
+    void* p = base + order[0] * line;
+    for (int w = 0; w < 3; w++)
+        for (size_t i = 0; i < lines; i++) p = *(void**)p;
+
+    for (int pass = 0; pass < passes; pass++) {
+        for (size_t i = 0; i < lines; i++) {
+            uint64_t t0 = read_timestamp();
+            p = *(void**)p;
+            asm volatile("" : "+r"(p));
+            uint64_t t1 = read_timestamp();
+            uint64_t dt = t1 - t0;
+            samples[(size_t)pass * lines + i] = (uint32_t)(dt > overhead ? dt - overhead : 0);
+        }
+    }
+    blackhole_ptr(p);
+
+    // Per-line medians (chain position i loads from line order[i])
+    vector<double> line_med(lines);
+    vector<double> col(passes);
+    for (size_t i = 0; i < lines; i++) {
+        for (int pass = 0; pass < passes; pass++) col[pass] = samples[(size_t)pass * lines + i];
+        line_med[order[i]] = median_of_vector(col);
+    }
+    double global_med = median_of_vector(line_med);
+    double slow_threshold = max(global_med * 1.5, global_med + 2.0);
+
+    // How often each line was slow, so one-off interrupts do not count
+    vector<int> slow_count(lines, 0);
+    for (int pass = 0; pass < passes; pass++)
+        for (size_t i = 0; i < lines; i++)
+            if (samples[(size_t)pass * lines + i] > slow_threshold)
+                slow_count[order[i]]++;
+
+    bool have_phys = virt_to_phys(base) != 0;
+    auto line_addr = [&](size_t l) {
+        uint64_t pa = virt_to_phys(base + l * line);
+        return pa ? pa : (uint64_t)(uintptr_t)(base + l * line);
+    };
+
+    cout << "Working set: " << ws / 1024 << " KB (" << lines << " lines of " << line
+         << " B), level L" << level << ": " << sets << " sets x " << ways << " ways\n";
+    cout << "Timer overhead: " << overhead << " cycles (subtracted), "
+         << passes << " passes\n";
+    cout << "Address source: " << (have_phys ? "physical (pagemap)" : "virtual (pagemap PFNs hidden)")
+         << "\n";
+    cout << "Median line latency: " << fixed << setprecision(1) << global_med << " cycles\n\n";
+
+    // Latency histogram of line medians; several modes hint at slice distances
+    cout << "Line median histogram (cycles):\n";
+    int width = max(4, (int)(global_med / 8));
+    map<int, size_t> hist;
+    for (double m : line_med) hist[(int)m / width * width]++;
+    for (auto& [bucket, n] : hist)
+        cout << setw(6) << bucket << "-" << setw(6) << left << bucket + width - 1 << right
+             << setw(8) << n << " lines\n";
+
+    // Per-set aggregation
+    vector<vector<double>> by_set(sets);
+    for (size_t l = 0; l < lines; l++)
+        by_set[(line_addr(l) / line) % sets].push_back(line_med[l]);
+
+    cout << "\nSlow sets (median > 1.3x overall):\n";
+    size_t slow_sets = 0;
+    for (size_t s = 0; s < sets; s++) {
+        if (by_set[s].empty()) continue;
+        double m = median_of_vector(by_set[s]);
+        if (m > global_med * 1.3) {
+            cout << "  set " << setw(6) << s << ": " << setprecision(1) << m
+                 << " cycles over " << by_set[s].size() << " lines\n";
+            slow_sets++;
+        }
+    }
+    if (!slow_sets) cout << "  none\n";
+
+    cout << "\nConsistently slow lines (slow in > 50% of passes):\n";
+    vector<size_t> slow;
+    for (size_t l = 0; l < lines; l++)
+        if (slow_count[l] * 2 > passes) slow.push_back(l);
+    sort(slow.begin(), slow.end(), [&](size_t a, size_t b) { return line_med[a] > line_med[b]; });
+
+    for (size_t j = 0; j < min<size_t>(slow.size(), 32); j++) {
+        size_t l = slow[j];
+        uint64_t addr = line_addr(l);
+        cout << "  0x" << hex << setw(12) << setfill('0') << addr << dec << setfill(' ')
+             << "  set " << setw(6) << (addr / line) % sets
+             << "  median " << setw(7) << setprecision(1) << line_med[l]
+             << "  slow " << setw(3) << slow_count[l] << "/" << passes << "\n";
+    }
+    if (slow.empty()) cout << "  none\n";
+    else if (slow.size() > 32) cout << "  ... " << slow.size() - 32 << " more\n";
+
+    free(base);
+    return 0;
+}
+
+// Coherence directory / snoop filter capacity.
+// Core B owns a set of lines, core A reads them (making them shared) and
+// B then re-reads and rewrites them. Compared with a control run where A
+// stays idle, extra latency on B for sets that still fit B's L2 means the
+// directory could not track the sharers and back-invalidated B's copies.
+struct CoherenceSample {
+    double reread_ns;   // B's chase latency per line after A's reads
+    double write_ns;    // B's store cost per line (includes invalidations)
+};
+
+CoherenceSample coherence_run(char* base, size_t lines, size_t line, bool shared,
+                              int owner_cpu, int reader_cpu) {
+    // Small sets get more rounds so each median covers enough lines
+    const int rounds = (int)max<size_t>(5, 65536 / lines);
+    atomic<int> phase{0};
+    vector<double> reread, write;
+
+    auto wait_phase = [&](int ph) {
+        while (phase.load(memory_order_acquire) != ph) this_thread::yield();
+    };
+
+    run_pinned_threads(2, {owner_cpu, reader_cpu}, [&](int t) {
+        for (int r = 0; r < rounds; r++) {
+            if (t == 1) {
+                // Reader (core A)
+                wait_phase(2 * r + 1);
+                if (shared) {
+                    uint64_t sum = 0;
+                    for (size_t l = 0; l < lines; l++)
+                        sum += *(volatile uint64_t*)(base + l * line + sizeof(void*));
+                    blackhole(sum);
+                }
+                phase.store(2 * r + 2, memory_order_release);
+                continue;
+            }
+
+            // Owner (core B): take every line in modified state
+            for (size_t l = 0; l < lines; l++) {
+                volatile uint64_t* q = (volatile uint64_t*)(base + l * line + sizeof(void*));
+                *q = *q + 1;
+            }
+            phase.store(2 * r + 1, memory_order_release);
+            wait_phase(2 * r + 2);
+
+            // Only the first pass sees the state A left behind
+            const void* p = base;
+            auto t0 = steady_clock::now();
+            for (size_t i = 0; i < lines; i++) {
+                p = *(void* const*)p;
+                asm volatile("" : "+r"(p));
+            }
+            auto t1 = steady_clock::now();
+            blackhole_ptr((void*)p);
+
+            for (size_t l = 0; l < lines; l++) {
+                volatile uint64_t* q = (volatile uint64_t*)(base + l * line + sizeof(void*));
+                *q = *q + 1;
+            }
+            auto t2 = steady_clock::now();
+
+            reread.push_back(duration_cast<duration<double, nano>>(t1 - t0).count() / lines);
+            write.push_back(duration_cast<duration<double, nano>>(t2 - t1).count() / lines);
+        }
+    });
+
+    return {median_of_vector(reread), median_of_vector(write)};
+}
+
+int run_coherence_probe(int reader_cpu) {
+    cout << "=== Coherence directory / snoop filter capacity ===\n";
+
+    vector<int> cpus = available_cpus();
+    int owner_cpu = cpus[0];
+    if (reader_cpu < 0) reader_cpu = cpus.size() > 1 ? cpus[1] : cpus[0];
+    if (reader_cpu == owner_cpu)
+        cout << "warning: owner and reader share CPU " << owner_cpu << "\n";
+
+    size_t line = reported_line_size();
+    size_t l2 = reported_cache_size(2);
+    size_t max_bytes = reported_cache_size(3);
+
+    char* base = (char*)allocate_aligned(PAGE_SIZE, max_bytes);
+    memset(base, 0, max_bytes);
+
+    cout << "Owner (B) = CPU " << owner_cpu << ", reader (A) = CPU " << reader_cpu
+         << ", L2 = " << l2 / 1024 << " KB\n";
+    cout << "     Set  Level   ctrl reread  shared reread   ratio   ctrl write  shared write   ratio\n";
+    cout << "                          (ns/line)                       (ns/line)\n";
+
+    size_t first_jump = 0;
+    for (size_t bytes = 16 * 1024; bytes <= max_bytes; bytes *= 2) {
+        size_t lines = bytes / line;
+        string point = "bytes=" + to_string(bytes) + " owner=" + to_string(owner_cpu) +
+                       " reader=" + to_string(reader_cpu);
+        vector<double> res = checkpointed(point, 4, [&] {
+            // Random chain over the lines, pointer in the first word of each line
+            vector<size_t> order(lines);
+            for (size_t i = 0; i < lines; i++) order[i] = i;
+            mt19937_64 rng(1234567);
+            shuffle(order.begin() + 1, order.end(), rng);
+            for (size_t i = 0; i < lines; i++)
+                *(void**)(base + order[i] * line) = base + order[(i + 1) % lines] * line;
+
+            CoherenceSample c = coherence_run(base, lines, line, false, owner_cpu, reader_cpu);
+            CoherenceSample s = coherence_run(base, lines, line, true,  owner_cpu, reader_cpu);
+            return vector<double>{c.reread_ns, c.write_ns, s.reread_ns, s.write_ns};
+        });
+        CoherenceSample ctrl{res[0], res[1]};
+        CoherenceSample shr{res[2], res[3]};
+
+        double rr = shr.reread_ns / ctrl.reread_ns;
+        double wr = shr.write_ns / ctrl.write_ns;
+        if (!first_jump && bytes <= l2 && rr > 1.3) first_jump = bytes;
+        string level = level_for_footprint(bytes);
+        for (auto [sharing, sample] : {pair{"ctrl", ctrl}, pair{"shared", shr}}) {
+            vector<pair<string, string>> labels = {{"sharing", sharing}, {"level", level},
+                                                   {"bytes", to_string(bytes)}};
+            record_metric("coherence_reread_ns", "Owner chase latency per line after the reader's pass",
+                          labels, sample.reread_ns);
+            record_metric("coherence_write_ns", "Owner store cost per line after the reader's pass",
+                          labels, sample.write_ns);
+        }
+
+        cout << setw(7) << bytes / 1024 << "K " << setw(5) << level_for_footprint(bytes)
+             << fixed << setprecision(3)
+             << setw(14) << ctrl.reread_ns << setw(15) << shr.reread_ns
+             << setw(8) << setprecision(2) << rr << setprecision(3)
+             << setw(13) << ctrl.write_ns << setw(14) << shr.write_ns
+             << setw(8) << setprecision(2) << wr << endl;
+    }
+
+    if (first_jump) {
+        cout << "--> owner loses L2-resident lines once " << first_jump / 1024
+             << " KB are shared: likely snoop filter / directory capacity\n";
+        record_metric("coherence_snoop_capacity_bytes", "Shared set size where the owner starts losing L2 lines",
+                      {}, first_jump);
+    }
+    else
+        cout << "--> no back-invalidation seen below the L2 size\n";
+
+    free(base);
+    return 0;
+}
+
+// Paging-structure cache probe.
+// Chains one line per region over sparse MAP_NORESERVE reservations.
+// With a 4 KiB stride all pages share upper-level entries, so a TLB miss
+// costs only the PTE fetch; 2 MiB, 1 GiB and 512 GiB strides give every
+// point its own PDE, PDPTE and PML4E, so walks also miss the caches for
+// those levels. Only probed pages are touched, keeping RSS small.
+const size_t PSC_MAX_RESERVE = 32ull << 40;   // Largest virtual reservation
+
+double paging_chain_latency(size_t stride, size_t points, bool& ok) {
+    ok = false;
+    if (stride * points > PSC_MAX_RESERVE) return 0;
+
+    string label = to_string(points) + " points, stride " + to_string(stride);
+    ChainPattern pat{label, stride * points, [&](char* base, size_t) {
+        // Spread the probed lines over page offsets so they do not share cache sets
+        auto point = [&](size_t i) {
+            return base + i * stride + (i * 64) % min<size_t>(stride, PAGE_SIZE);
+        };
+
+        vector<size_t> order(points);
+        for (size_t i = 0; i < points; i++) order[i] = i;
+        mt19937_64 rng(1234567);
+        shuffle(order.begin(), order.end(), rng);
+        for (size_t i = 0; i < points; i++)
+            *(void**)point(order[i]) = point(order[(i + 1) % points]);
+        return ChainLayout{(void**)point(order[0]), points};
+    }};
+    pat.sparse = true;
+
+    SampleStats s = measure_pattern(pat, 3);
+    ok = s.kept > 0;
+    return s.median;
+}
+
+int run_paging_probe() {
+    cout << "=== Paging-structure cache probe ===\n";
+
+    struct Stride { size_t bytes; const char* name; };
+    vector<Stride> strides = {
+        {4096, "4K"}, {2ull << 20, "2M"}, {1ull << 30, "1G"}, {512ull << 30, "512G"}
+    };
+    vector<size_t> counts = {16, 64, 512, 2048, 8192};
+
+    cout << "Latency per access (ns), one line per region:\n";
+    cout << " Points";
+    for (auto& s : strides) cout << setw(12) << s.name;
+    cout << endl;
+
+    vector<vector<double>> lat(counts.size(), vector<double>(strides.size(), 0));
+    for (size_t c = 0; c < counts.size(); c++) {
+        cout << setw(7) << counts[c];
+        for (size_t s = 0; s < strides.size(); s++) {
+            bool ok;
+            lat[c][s] = paging_chain_latency(strides[s].bytes, counts[c], ok);
+            if (ok) cout << setw(12) << fixed << setprecision(3) << lat[c][s];
+            else cout << setw(12) << "skip";
+        }
+        cout << endl;
+    }
+
+    // Extra cost of each level over the next denser one, at the largest
+    // count both strides could reserve: one more paging-structure cache miss
+    cout << "\nWalk penalty vs next denser stride (ns per access):\n";
+    for (size_t s = 1; s < strides.size(); s++) {
+        for (size_t c = counts.size(); c-- > 0;) {
+            if (lat[c][s] == 0 || lat[c][s - 1] == 0) continue;
+            cout << "  " << setw(5) << strides[s].name << " vs " << setw(3) << strides[s - 1].name
+                 << ": " << showpos << fixed << setprecision(3) << lat[c][s] - lat[c][s - 1]
+                 << noshowpos << " ns at " << counts[c] << " points\n";
+            break;
+        }
+    }
+
+    cout << "Dummy: " << dummy_sink << "\n";
+    return 0;
+}
+
+// Memory disambiguation predictor probe.
+// Each iteration loads through an early index, derives the next store
+// address from the loaded value (two divides, so it resolves late) and
+// stores there. The next load aliases that store at a controlled rate:
+//   serialized  - load address depends on the store address (no speculation)
+//   speculative - independent load, the predictor decides whether to wait
+//   reordered   - next load hoisted above the store (what breaking the alias buys)
+// Without aliasing a speculating core overlaps iterations; an aliasing load
+// must wait for the store, and a mispredicted one costs a machine clear.
+enum class AliasVariant { Serialized, Speculative, Reordered };
+
+const size_t ALIAS_BUF = 4096;              // Elements, fits L1
+const size_t ALIAS_TABLE = 1 << 16;
+const size_t ALIAS_ITERS = 1 << 22;
+
+volatile uint64_t alias_one = 1;            // Runtime 1 the compiler cannot fold
+
+struct AliasResult {
+    double ns_per_iter;
+    double clears_per_kiter;                // -1 when the counter is unavailable
+};
+
+AliasResult alias_run(AliasVariant v, const vector<uint32_t>& sidx,
+                      const vector<uint32_t>& lidx, int clear_fd) {
+    const size_t mask = ALIAS_TABLE - 1;
+    vector<uint64_t> buf(ALIAS_BUF, 1);
+    uint64_t* b = buf.data();
+    uint64_t one = alias_one, acc = 0;
+    size_t prev_s = 0;
+
+    if (clear_fd >= 0) ioctl(clear_fd, PERF_EVENT_IOC_RESET, 0);
+    uint64_t c0 = read_perf_counter(clear_fd);
+    auto t0 = steady_clock::now();
+
+    if (v == AliasVariant::Reordered) {
+        uint64_t next = b[lidx[0]] + 1;
+        for (size_t i = 0; i < ALIAS_ITERS; i++) {
+            uint64_t x = next;
+            size_t s = x / one / one;
+            s = sidx[i & mask] + (s >> 63);
+            next = b[lidx[(i + 1) & mask]] + 1;
+            b[s] = x;
+            acc += x;
+        }
+    } else {
+        for (size_t i = 0; i < ALIAS_ITERS; i++) {
+            size_t l = lidx[i & mask];
+            // Store indices are small, so the shift is 0 but carries the dependency
+            if (v == AliasVariant::Serialized) l += prev_s >> 63;
+            uint64_t x = b[l] + 1;
+            size_t s = x / one / one;
+            s = sidx[i & mask] + (s >> 63);
+            b[s] = x;
+            prev_s = s;
+            asm volatile("" : "+r"(prev_s));    // Hide the index range from the optimizer
+            acc += x;
+        }
+    }
+
+    auto t1 = steady_clock::now();
+    uint64_t c1 = read_perf_counter(clear_fd);
+    dummy_sink = dummy_sink ^ acc;
+
+    double ns = duration_cast<duration<double, nano>>(t1 - t0).count();
+    return {ns / ALIAS_ITERS, clear_fd >= 0 ? 1000.0 * (c1 - c0) / ALIAS_ITERS : -1};
+}
+
+int run_disambiguation_probe() {
+    cout << "=== Memory disambiguation predictor ===\n";
+
+    // Machine clears caused by memory-ordering violations (Intel only)
+    int clear_fd = -1;
+    if (cpu_vendor() == "GenuineIntel")
+        clear_fd = open_perf_counter(PERF_TYPE_RAW, 0x02C3); // MACHINE_CLEARS.MEMORY_ORDERING
+    cout << "Machine-clear counter: " << (clear_fd >= 0 ? "available" : "not available") << "\n";
+
+    vector<int> rates = {0, 1, 2, 5, 10, 25, 50, 75, 100};
+    const char* names[] = {"serialized", "speculative", "reordered"};
+    AliasVariant variants[] = {
+        AliasVariant::Serialized, AliasVariant::Speculative, AliasVariant::Reordered
+    };
+
+    cout << "Alias%  serialized speculative   reordered   (ns/iter)   clears/Kiter\n";
+
+    vector<double> spec_ns;
+    double serial0 = 0, reorder0 = 0;
+
+    for (int rate : rates) {
+        // Store and load indices; a load hits the previous iteration's
+        // store at `rate`% and otherwise some other element
+        mt19937_64 rng(1234567 + rate);
+        vector<uint32_t> sidx(ALIAS_TABLE), lidx(ALIAS_TABLE);
+        for (size_t i = 0; i < ALIAS_TABLE; i++) sidx[i] = rng() % ALIAS_BUF;
+        for (size_t i = 0; i < ALIAS_TABLE; i++) {
+            uint32_t prev = sidx[(i - 1) & (ALIAS_TABLE - 1)];
+            if ((int)(rng() % 100) < rate) lidx[i] = prev;
+            else lidx[i] = (prev + 1 + rng() % (ALIAS_BUF - 1)) % ALIAS_BUF;
+        }
+
+        double ns[3], clears = -1;
+        for (int v = 0; v < 3; v++) {
+            vector<double> reps, creps;
+            for (int r = 0; r < 5; r++) {
+                AliasResult res = alias_run(variants[v], sidx, lidx, clear_fd);
+                reps.push_back(res.ns_per_iter);
+                creps.push_back(res.clears_per_kiter);
+            }
+            ns[v] = median_of_vector(reps);
+            if (variants[v] == AliasVariant::Speculative) clears = median_of_vector(creps);
+        }
+
+        if (rate == 0) { serial0 = ns[0]; reorder0 = ns[2]; }
+        spec_ns.push_back(ns[1]);
+
+        cout << setw(6) << rate << fixed << setprecision(3)
+             << setw(12) << ns[0] << setw(12) << ns[1] << setw(12) << ns[2];
+        if (clears >= 0) cout << setw(27) << setprecision(2) << clears;
+        else cout << setw(27) << "n/a";
+        cout << endl;
+    }
+
+    // Cost per mispredicted alias: least-squares slope of the speculative
+    // curve over the low rates, where the predictor cannot learn to wait
+    double sxy = 0, sxx = 0;
+    for (size_t i = 1; i < rates.size() && rates[i] <= 10; i++) {
+        double p = rates[i] / 100.0;
+        sxy += p * (spec_ns[i] - spec_ns[0]);
+        sxx += p * p;
+    }
+    double per_alias = sxx > 0 ? sxy / sxx : 0;
+
+    cout << "\nSpeculation benefit at 0% aliasing: " << fixed << setprecision(3)
+         << serial0 - spec_ns[0] << " ns/iter (" << names[0] << " - " << names[1] << ")\n";
+    cout << "Cost per aliasing iteration (low rates): " << per_alias << " ns\n";
+    cout << "Breaking the alias (reordered) saves " << spec_ns[0] - reorder0
+         << " ns/iter at 0% and " << spec_ns.back() - reorder0 << " ns/iter at 100%\n";
+
+    if (clear_fd >= 0) close(clear_fd);
+    cout << "Dummy: " << dummy_sink << "\n";
+    return 0;
+}
+
+// Load-to-use latency by addressing mode.
+// The same random cycle over the same lines is chased with hand-written
+// loads so the addressing mode is fixed rather than compiler-chosen:
+// [reg], [reg+disp8], [reg+disp32], [base+idx*8] and a 32-bit index chain.
+// Some cores shave a cycle off the simple [reg] / [reg+disp8] forms.
+enum class AddrMode { Base, Disp8, Disp32, Index64, Index32 };
+
+const size_t ADDR_LOADS = 4'000'000;        // Loads per measurement (multiple of 16)
+
+#if defined(__x86_64__)
+// Store the cycle `order` in `buf` in the layout `mode` expects and return
+// the starting register value
+uint64_t build_addressing_chain(AddrMode mode, char* buf, const vector<size_t>& order,
+                                size_t line) {
+    size_t n = order.size();
+    auto at = [&](size_t i) { return buf + order[i % n] * line; };
+
+    for (size_t i = 0; i < n; i++) {
+        switch (mode) {
+        case AddrMode::Base:    *(char**)at(i) = at(i + 1);       break;
+        case AddrMode::Disp8:   *(char**)at(i) = at(i + 1) - 8;   break;
+        case AddrMode::Disp32:  *(char**)at(i) = at(i + 1) - 256; break;
+        case AddrMode::Index64: *(uint64_t*)at(i) = (at(i + 1) - buf) / 8; break;
+        case AddrMode::Index32: *(uint32_t*)at(i) = (uint32_t)((at(i + 1) - buf) / 4); break;
+        }
+    }
+
+    switch (mode) {
+    case AddrMode::Base:    return (uint64_t)at(0);
+    case AddrMode::Disp8:   return (uint64_t)(at(0) - 8);
+    case AddrMode::Disp32:  return (uint64_t)(at(0) - 256);
+    case AddrMode::Index64: return (at(0) - buf) / 8;
+    case AddrMode::Index32: return (at(0) - buf) / 4;
+    }
+    return 0;
+}
+
+// Chase `loads` hops; returns ns per load
+double chase_addressing_mode(AddrMode mode, char* buf, uint64_t r, size_t loads) {
+    auto t0 = steady_clock::now();
+    for (size_t i = 0; i < loads; i += 16) {
+        switch (mode) {
+        case AddrMode::Base:
+            asm volatile(".rept 16\n\tmov (%0), %0\n\t.endr" : "+r"(r) : : "memory");
+            break;
+        case AddrMode::Disp8:
+            asm volatile(".rept 16\n\tmov 8(%0), %0\n\t.endr" : "+r"(r) : : "memory");
+            break;
+        case AddrMode::Disp32:
+            asm volatile(".rept 16\n\tmov 256(%0), %0\n\t.endr" : "+r"(r) : : "memory");
+            break;
+        case AddrMode::Index64:
+            asm volatile(".rept 16\n\tmov (%1,%0,8), %0\n\t.endr" : "+r"(r) : "r"(buf) : "memory");
+            break;
+        case AddrMode::Index32:
+            asm volatile(".rept 16\n\tmovl (%1,%0,4), %k0\n\t.endr" : "+r"(r) : "r"(buf) : "memory");
+            break;
+        }
+    }
+    auto t1 = steady_clock::now();
+    dummy_sink = dummy_sink ^ r;
+    return duration_cast<duration<double, nano>>(t1 - t0).count() / loads;
+}
+
+int run_addressing_probe() {
+    cout << "=== Load-to-use latency by addressing mode ===\n";
+
+    size_t line = reported_line_size();
+    struct Level { const char* name; size_t bytes; };
+    vector<Level> levels = {
+        {"L1", reported_cache_size(1) / 2},
+        {"L2", reported_cache_size(2) / 2},
+    };
+
+    const char* names[] = {"[reg]", "[reg+disp8]", "[reg+disp32]", "[base+idx*8]", "[base+idx32*4]"};
+    AddrMode modes[] = {
+        AddrMode::Base, AddrMode::Disp8, AddrMode::Disp32, AddrMode::Index64, AddrMode::Index32
+    };
+
+    cout << "Mode            ";
+    for (auto& l : levels) cout << setw(13) << string(l.name) + " ns" << setw(10) << "vs [reg]";
+    cout << endl;
+
+    vector<vector<double>> lat(5, vector<double>(levels.size()));
+    for (size_t li = 0; li < levels.size(); li++) {
+        size_t lines = levels[li].bytes / line;
+        char* buf = (char*)allocate_aligned(PAGE_SIZE, levels[li].bytes);
+        memset(buf, 0, levels[li].bytes);
+
+        vector<size_t> order(lines);
+        for (size_t i = 0; i < lines; i++) order[i] = i;
+        mt19937_64 rng(1234567);
+        shuffle(order.begin(), order.end(), rng);
+
+        for (int m = 0; m < 5; m++) {
+            uint64_t start = build_addressing_chain(modes[m], buf, order, line);
+            chase_addressing_mode(modes[m], buf, start, lines * 4);   // Warm-up
+
+            vector<double> reps;
+            for (int r = 0; r < MEASURE_REPEATS / 2; r++)
+                reps.push_back(chase_addressing_mode(modes[m], buf, start, ADDR_LOADS));
+            lat[m][li] = summarize_samples(reps).median;
+        }
+        free(buf);
+    }
+
+    for (int m = 0; m < 5; m++) {
+        cout << left << setw(16) << names[m] << right;
+        for (size_t li = 0; li < levels.size(); li++)
+            cout << setw(13) << fixed << setprecision(3) << lat[m][li]
+                 << setw(10) << setprecision(2) << lat[m][li] / lat[0][li];
+        cout << endl;
+    }
+
+    cout << "Dummy: " << dummy_sink << "\n";
+    return 0;
+}
+#else
+int run_addressing_probe() {
+    cout << "Addressing-mode probe needs x86-64 inline assembly\n";
+    return 1;
+}
+#endif
+
+// Branch target buffer and predictor capacity.
+// Code with K branches is generated at runtime so the number of branches,
+// their spacing and their outcome patterns are exact:
+//   btb       - K always-taken jumps; cost rises once targets stop fitting the BTB
+//   cond      - K conditional branches whose directions follow a repeating
+//               per-call pattern; mispredictions rise when history tables fill
+//   indirect  - one dispatch site (interpreter style) over T targets with a
+//               short repeating sequence (history predictable) or a random one
+#if defined(__x86_64__)
+struct CodeBuffer {
+    vector<uint8_t> bytes;
+
+    size_t pos() const { return bytes.size(); }
+    void emit(initializer_list<uint8_t> b) { bytes.insert(bytes.end(), b); }
+    void emit32(int32_t v) {
+        for (int i = 0; i < 4; i++) bytes.push_back((uint8_t)(v >> (8 * i)));
+    }
+    void pad_to(size_t p) { while (bytes.size() < p) bytes.push_back(0x90); } // nop
+    void patch_rel32(size_t at, size_t target) {
+        int32_t rel = (int32_t)(target - (at + 4));
+        memcpy(&bytes[at], &rel, 4);
+    }
+
+    // Copy into fresh executable pages; caller releases with release_code
+    void* finalize(size_t& mapped) const {
+        mapped = (bytes.size() + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+        void* code = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code == MAP_FAILED) return nullptr;
+        memcpy(code, bytes.data(), bytes.size());
+        if (mprotect(code, mapped, PROT_READ | PROT_EXEC) != 0) {
+            munmap(code, mapped);
+            return nullptr;
+        }
+        return code;
+    }
+};
+
+void release_code(void* code, size_t mapped) {
+    if (code) munmap(code, mapped);
+}
+
+// K jmp rel32, each jumping to the next slot `spacing` bytes on, then ret
+void* build_jump_chain(size_t k, size_t spacing, size_t& mapped) {
+    CodeBuffer cb;
+    for (size_t i = 0; i < k; i++) {
+        size_t slot = i * spacing;
+        cb.pad_to(slot);
+        cb.emit({0xE9});                        // jmp rel32
+        size_t rel = cb.pos();
+        cb.emit32(0);
+        cb.pad_to(slot + spacing);
+        cb.patch_rel32(rel, slot + spacing);
+    }
+    cb.emit({0xC3});                            // ret
+    return cb.finalize(mapped);
+}
+
+// K blocks "bt rdi, j%64; jc next" padded to `spacing` bytes, then ret.
+// Taken and fall-through paths meet at the next block.
+void* build_conditional_chain(size_t k, size_t spacing, size_t& mapped) {
+    CodeBuffer cb;
+    for (size_t i = 0; i < k; i++) {
+        size_t slot = i * spacing;
+        cb.pad_to(slot);
+        cb.emit({0x48, 0x0F, 0xBA, 0xE7, (uint8_t)(i % 64)}); // bt rdi, imm8
+        cb.emit({0x0F, 0x82});                                 // jc rel32
+        size_t rel = cb.pos();
+        cb.emit32(0);
+        cb.pad_to(slot + spacing);
+        cb.patch_rel32(rel, slot + spacing);
+    }
+    cb.emit({0xC3});
+    return cb.finalize(mapped);
+}
+
+// Dispatch loop: "mov rax,[rdi]; add rdi,8; jmp rax" over a sequence of
+// target addresses; each of the T targets does "dec rsi; jnz loop; ret".
+// Target entry offsets are written to `targets`.
+void* build_indirect_dispatch(size_t t, vector<size_t>& targets, size_t& mapped) {
+    CodeBuffer cb;
+    cb.emit({0x48, 0x8B, 0x07});                // mov rax, [rdi]
+    cb.emit({0x48, 0x83, 0xC7, 0x08});          // add rdi, 8
+    cb.emit({0xFF, 0xE0});                      // jmp rax
+
+    targets.clear();
+    for (size_t i = 0; i < t; i++) {
+        cb.pad_to(64 * (i + 1));
+        targets.push_back(cb.pos());
+        cb.emit({0x48, 0xFF, 0xCE});            // dec rsi
+        cb.emit({0x0F, 0x85});                  // jnz loop
+        size_t rel = cb.pos();
+        cb.emit32(0);
+        cb.patch_rel32(rel, 0);
+        cb.emit({0xC3});                        // ret
+    }
+    return cb.finalize(mapped);
+}
+
+struct BranchCost {
+    double ns_per_branch;
+    double misses_per_branch;                   // -1 without a counter
+};
+
+// Time `run` (which executes `branches` branches) with the branch-miss counter
+template<typename F>
+BranchCost time_branches(F run, size_t branches, int miss_fd) {
+    run();                                      // Train predictors
+    run();
+
+    vector<double> reps, mreps;
+    for (int r = 0; r < 5; r++) {
+        uint64_t m0 = read_perf_counter(miss_fd);
+        auto t0 = steady_clock::now();
+        run();
+        auto t1 = steady_clock::now();
+        uint64_t m1 = read_perf_counter(miss_fd);
+        reps.push_back(duration_cast<duration<double, nano>>(t1 - t0).count() / branches);
+        mreps.push_back((double)(m1 - m0) / branches);
+    }
+    return {median_of_vector(reps), miss_fd >= 0 ? median_of_vector(mreps) : -1};
+}
+
+void print_branch_cost(const BranchCost& c) {
+    cout << setw(10) << fixed << setprecision(3) << c.ns_per_branch;
+    if (c.misses_per_branch >= 0) cout << setw(8) << setprecision(3) << c.misses_per_branch;
+    else cout << setw(8) << "n/a";
+}
+
+int run_branch_probe() {
+    cout << "=== Branch target buffer and predictor capacity ===\n";
+
+    int miss_fd = open_perf_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    cout << "Branch-miss counter: " << (miss_fd >= 0 ? "available" : "not available") << "\n";
+    const size_t budget = 4'000'000;            // Branches per measurement
+
+    // 1. BTB capacity: taken jumps by count and spacing
+    vector<size_t> spacings = {8, 16, 64};
+    cout << "\nTaken jumps (ns/branch, misses/branch) by spacing:\n      K";
+    for (size_t s : spacings) cout << setw(12) << to_string(s) + "B" << setw(6) << "";
+    cout << endl;
+
+    vector<size_t> btb_capacity(spacings.size(), 0);
+    vector<double> btb_base(spacings.size(), 0);
+    for (size_t k = 16; k <= 16384; k *= 2) {
+        cout << setw(7) << k;
+        for (size_t si = 0; si < spacings.size(); si++) {
+            size_t mapped;
+            void* code = build_jump_chain(k, spacings[si], mapped);
+            if (!code) { cout << setw(18) << "mmap failed"; continue; }
+            auto fn = (void (*)())code;
+            size_t calls = max<size_t>(1, budget / k);
+
+            BranchCost c = time_branches([&] {
+                for (size_t i = 0; i < calls; i++) fn();
+            }, calls * k, miss_fd);
+            release_code(code, mapped);
+
+            // Capacity: last K before the cost first exceeds 1.5x the best so far
+            if (k == 16 || c.ns_per_branch < btb_base[si]) btb_base[si] = c.ns_per_branch;
+            if (btb_capacity[si] == k / 2 || k == 16)
+                if (c.ns_per_branch < btb_base[si] * 1.5) btb_capacity[si] = k;
+            print_branch_cost(c);
+        }
+        cout << endl;
+    }
+    for (size_t si = 0; si < spacings.size(); si++)
+        cout << "--> " << spacings[si] << "B spacing: taken branches stay cheap up to ~"
+             << btb_capacity[si] << "\n";
+
+    // 2. Conditional pattern capacity: K branches, period-32 random patterns
+    const size_t period = 32;
+    vector<uint64_t> patterns(period);
+    mt19937_64 rng(1234567);
+    for (auto& p : patterns) p = rng();
+
+    cout << "\nConditional branches, direction pattern period " << period << ":\n"
+         << "      K   ns/branch  misses\n";
+    size_t cond_capacity = 0;
+    double cond_base = 0;
+    for (size_t k = 16; k <= 8192; k *= 2) {
+        size_t mapped;
+        void* code = build_conditional_chain(k, 16, mapped);
+        if (!code) continue;
+        auto fn = (void (*)(uint64_t))code;
+        size_t calls = max<size_t>(period, budget / k / period * period);
+
+        BranchCost c = time_branches([&] {
+            for (size_t i = 0; i < calls; i++) fn(patterns[i % period]);
+        }, calls * k, miss_fd);
+        release_code(code, mapped);
+
+        if (k == 16 || c.ns_per_branch < cond_base) cond_base = c.ns_per_branch;
+        if (cond_capacity == k / 2 || k == 16)
+            if (c.ns_per_branch < cond_base * 1.5) cond_capacity = k;
+        cout << setw(7) << k;
+        print_branch_cost(c);
+        cout << endl;
+    }
+    cout << "--> patterns tracked for up to ~" << cond_capacity << " branches ("
+         << cond_capacity * period << " outcomes)\n";
+
+    // 3. Indirect dispatch: history-predictable vs random target sequences
+    const size_t seq_len = 4096;
+    cout << "\nIndirect dispatch over T targets (ns/dispatch, misses/dispatch):\n"
+         << "      T   period-16 sequence     random sequence\n";
+    for (size_t t = 1; t <= 256; t *= 2) {
+        size_t mapped;
+        vector<size_t> offsets;
+        void* code = build_indirect_dispatch(t, offsets, mapped);
+        if (!code) continue;
+        auto fn = (void (*)(const uint64_t*, uint64_t))code;
+
+        vector<uint64_t> periodic(seq_len), random(seq_len);
+        vector<size_t> cycle(16);
+        for (auto& c : cycle) c = rng() % t;
+        for (size_t i = 0; i < seq_len; i++) {
+            periodic[i] = (uint64_t)code + offsets[cycle[i % 16]];
+            random[i] = (uint64_t)code + offsets[rng() % t];
+        }
+
+        size_t calls = budget / seq_len;
+        cout << setw(7) << t;
+        for (auto* seq : {&periodic, &random}) {
+            BranchCost c = time_branches([&] {
+                for (size_t i = 0; i < calls; i++) fn(seq->data(), seq_len);
+            }, calls * seq_len, miss_fd);
+            print_branch_cost(c);
+            cout << "  ";
+        }
+        cout << endl;
+        release_code(code, mapped);
+    }
+
+    if (miss_fd >= 0) close(miss_fd);
+    return 0;
+}
+#else
+int run_branch_probe() {
+    cout << "Branch probe needs an x86-64 code generator\n";
+    return 1;
+}
+#endif
+
+// Host environment: hypervisor presence and steal time.
+// Printed with every run so VM results are never mistaken for bare metal.
+struct HostEnvironment {
+    bool hypervisor_bit = false;     // CPUID.1:ECX[31]
+    string hypervisor_vendor;        // CPUID leaf 0x40000000 signature
+    string sys_hypervisor;           // /sys/hypervisor/type (Xen and friends)
+    string dmi;                      // DMI system vendor / product
+    uint64_t steal_start = 0;        // /proc/stat steal ticks at start
+    uint64_t total_start = 0;
+};
+
+// Aggregate steal and total CPU ticks from the first line of /proc/stat
+bool read_steal_ticks(uint64_t& steal, uint64_t& total) {
+    ifstream f("/proc/stat");
+    string cpu;
+    uint64_t v[8] = {0};
+    if (!(f >> cpu) || cpu != "cpu") return false;
+    total = 0;
+    for (int i = 0; i < 8 && (f >> v[i]); i++) total += v[i];
+    steal = v[7];
+    return total > 0;
+}
+
+string read_first_line(const string& path) {
+    ifstream f(path);
+    string s;
+    getline(f, s);
+    return s;
+}
+
+HostEnvironment detect_host_environment() {
+    HostEnvironment env;
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned a, b, c, d;
+    if (__get_cpuid(1, &a, &b, &c, &d)) env.hypervisor_bit = (c >> 31) & 1;
+    if (env.hypervisor_bit) {
+        __cpuid(0x40000000, a, b, c, d);
+        char sig[13];
+        memcpy(sig, &b, 4);
+        memcpy(sig + 4, &c, 4);
+        memcpy(sig + 8, &d, 4);
+        sig[12] = 0;
+        env.hypervisor_vendor = sig;
+    }
+#endif
+    env.sys_hypervisor = read_first_line("/sys/hypervisor/type");
+    string vendor = read_first_line("/sys/class/dmi/id/sys_vendor");
+    string product = read_first_line("/sys/class/dmi/id/product_name");
+    env.dmi = vendor + (product.empty() ? "" : " / " + product);
+    read_steal_ticks(env.steal_start, env.total_start);
+    return env;
+}
+
+bool is_virtualized(const HostEnvironment& env) {
+    return env.hypervisor_bit || !env.sys_hypervisor.empty();
+}
+
+// What must stay the same for checkpointed points to be comparable
+string environment_fingerprint(const HostEnvironment& env) {
+    string model;
+    ifstream cpuinfo("/proc/cpuinfo");
+    string line;
+    while (getline(cpuinfo, line))
+        if (line.rfind("model name", 0) == 0) {
+            model = line.substr(line.find(':') + 2);
+            break;
+        }
+    utsname u;
+    uname(&u);
+
+    ostringstream fp;
+    fp << "cpu=" << model << ";cpus=" << available_cpus().size() << ";runner_cpu=" << RUNNER_CPU
+       << ";l1=" << reported_cache_size(1) << ";l2=" << reported_cache_size(2)
+       << ";l3=" << reported_cache_size(3) << ";line=" << reported_line_size()
+       << ";kernel=" << u.release << ";hypervisor=" << env.hypervisor_vendor << ";dmi=" << env.dmi;
+    return fp.str();
+}
+
+void print_host_environment(const HostEnvironment& env) {
+    record_metric("host_info", "Host environment (value is always 1)",
+                  {{"virtualized", is_virtualized(env) ? "1" : "0"},
+                   {"hypervisor", env.hypervisor_vendor}}, 1);
+
+    cout << "Host: " << (is_virtualized(env) ? "virtual machine" : "bare metal");
+    if (!env.hypervisor_vendor.empty()) cout << ", hypervisor '" << env.hypervisor_vendor << "'";
+    if (!env.sys_hypervisor.empty())    cout << ", /sys/hypervisor " << env.sys_hypervisor;
+    if (!env.dmi.empty())               cout << ", DMI " << env.dmi;
+    cout << "\n";
+}
+
+// Share of CPU time stolen by the hypervisor since detect_host_environment
+void print_steal_since(const HostEnvironment& env) {
+    uint64_t steal, total;
+    if (!read_steal_ticks(steal, total) || total <= env.total_start) return;
+    double pct = 100.0 * (steal - env.steal_start) / (total - env.total_start);
+    cout << "Steal time during run: " << fixed << setprecision(2) << pct << "%\n";
+    record_metric("steal_percent", "Hypervisor steal time during the run", {}, pct);
+}
+
+// Page-walk penalty under the current paging setup.
+// A chain over one line per 4K page (every hop misses the STLB) is compared
+// with the same number of lines packed into few pages. Under a hypervisor
+// the walk is two-dimensional, so the penalty over a bare-metal baseline
+// (pass it in ns, e.g. from the same CPU model on bare metal) is the
+// nested-paging overhead.
+int run_virtualization_probe(double baseline_ns) {
+    cout << "=== Virtualization and nested page-walk overhead ===\n";
+
+    HostEnvironment env = detect_host_environment();
+    const size_t points = 16384;   // Well beyond any STLB
+
+    bool ok_dense, ok_sparse, ok_2m;
+    double dense  = paging_chain_latency(64, points, ok_dense);
+    double sparse = paging_chain_latency(4096, points, ok_sparse);
+    double huge   = paging_chain_latency(2ull << 20, points, ok_2m);
+    if (!ok_dense || !ok_sparse) {
+        cout << "Could not reserve the probe ranges\n";
+        return 1;
+    }
+
+    double walk = sparse - dense;
+    cout << fixed << setprecision(3)
+         << "Packed lines (TLB hits):   " << dense << " ns\n"
+         << "One line per 4K page:      " << sparse << " ns\n";
+    if (ok_2m) cout << "One line per 2M region:    " << huge << " ns\n";
+    cout << "Page-walk penalty (4K):    " << walk << " ns\n";
+    record_metric("page_walk_penalty_ns", "Latency added by a TLB miss and page walk",
+                  {{"page", "4K"}}, walk);
+    if (ok_2m) cout << "Page-walk penalty (2M):    " << huge - dense << " ns\n";
+
+    if (baseline_ns > 0) {
+        cout << "Bare-metal baseline:       " << baseline_ns << " ns\n"
+             << "Nested paging overhead:    " << walk - baseline_ns << " ns ("
+             << setprecision(2) << walk / baseline_ns << "x)\n";
+    } else if (is_virtualized(env)) {
+        cout << "Pass a bare-metal walk penalty to compare: virt <ns>\n";
+    }
+    return 0;
+}
+
+// Current frequency of `cpu` in MHz from cpufreq, or an estimate from a
+// dependent add chain (one add per cycle) when cpufreq is not exposed
+double current_core_mhz(int cpu) {
+    ifstream f("/sys/devices/system/cpu/cpu" + to_string(cpu) + "/cpufreq/scaling_cur_freq");
+    double khz = 0;
+    if (f >> khz && khz > 0) return khz / 1000;
+
+#if defined(__x86_64__) || defined(__i386__)
+    const size_t adds = 4'000'000;
+    uint64_t x = 0;
+    auto t0 = steady_clock::now();
+    for (size_t i = 0; i < adds; i += 8)
+        asm volatile(".rept 8\n\tadd $1, %0\n\t.endr" : "+r"(x));
+    auto t1 = steady_clock::now();
+    blackhole(x);
+    return adds / duration_cast<duration<double, micro>>(t1 - t0).count();
+#else
+    return 0;
+#endif
+}
+
+// Hottest thermal zone in degrees C, or NaN without /sys/class/thermal
+double max_thermal_celsius() {
+    double best = NAN;
+    for (int z = 0; z < 64; z++) {
+        ifstream f("/sys/class/thermal/thermal_zone" + to_string(z) + "/temp");
+        double milli;
+        if (!(f >> milli)) continue;
+        if (isnan(best) || milli / 1000 > best) best = milli / 1000;
+    }
+    return best;
+}
+
+// Long-running soak: the same measurement points, once per second, for
+// minutes or hours. The timestamped series shows thermal throttling,
+// periodic background work and drift that a one-shot run averages away.
+struct SoakPoint {
+    string name;
+    size_t bytes;
+    void** chain;
+    vector<double> series;
+    size_t discarded = 0;
+};
+
+int run_soak_probe(int duration_s, const string& levels) {
+    cout << "=== Soak mode ===\n";
+    if (duration_s <= 0) duration_s = 60;
+
+    runner_place();
+    int cpu = MEASURE_CPU;
+
+    // One working set per requested level, sized well inside it
+    vector<SoakPoint> points;
+    auto want = [&](const string& l) {
+        return levels.empty() || ("," + levels + ",").find("," + l + ",") != string::npos;
+    };
+    if (want("L1"))   points.push_back({"L1",   reported_cache_size(1) / 2, nullptr, {}});
+    if (want("L2"))   points.push_back({"L2",   reported_cache_size(2) / 2, nullptr, {}});
+    if (want("L3"))   points.push_back({"L3",   reported_cache_size(3) / 2, nullptr, {}});
+    if (want("DRAM")) points.push_back({"DRAM", reported_cache_size(3) * 4, nullptr, {}});
+    if (points.empty()) {
+        cout << "No known levels in '" << levels << "' (use L1,L2,L3,DRAM)\n";
+        return 1;
+    }
+
+    for (auto& p : points) {
+        p.chain = (void**)allocate_aligned(PAGE_SIZE, p.bytes);
+        create_random_chain(p.chain, p.bytes / sizeof(void*));
+    }
+
+    const int samples = 7;
+    const size_t hops = 200'000;
+
+    cout << "Duration " << duration_s << " s on CPU " << cpu << ", " << samples
+         << " samples of " << hops << " hops per point per second\n";
+    cout << "time_s,epoch_ms,point,ns,kept,discarded,mhz,temp_c\n";
+
+    auto start = steady_clock::now();
+    double min_mhz = 1e18, max_temp = NAN;
+
+    for (int tick = 0; ; tick++) {
+        auto tick_start = start + seconds(tick);
+        if (tick_start >= start + seconds(duration_s)) break;
+        this_thread::sleep_until(tick_start);
+
+        double mhz = current_core_mhz(cpu);
+        double temp = max_thermal_celsius();
+        trace_counter("core MHz", mhz);
+        if (!isnan(temp)) trace_counter("temperature C", temp);
+        min_mhz = min(min_mhz, mhz);
+        if (!isnan(temp) && (isnan(max_temp) || temp > max_temp)) max_temp = temp;
+
+        for (auto& p : points) {
+            vector<double> batch;
+            for (int s = 0; s < samples; s++)
+                batch.push_back(measure_chain_latency(p.chain, p.bytes / sizeof(void*), hops));
+
+            SampleStats st = summarize_samples(batch);
+            p.discarded += st.discarded;
+            trace_counter(p.name + " ns", st.median);
+            record_metric("latency_ns", "Pointer-chase latency per cache level",
+                          {{"level", p.name}, {"stat", "last"}}, st.median);
+            record_metric("discarded_samples", "Samples dropped as outliers",
+                          {{"level", p.name}}, (double)p.discarded);
+            if (st.discarded)
+                trace_instant("discarded samples", "sample",
+                              "\"point\":\"" + p.name + "\",\"count\":" + to_string(st.discarded));
+            double value = st.median;
+            p.series.push_back(value);
+
+            double elapsed = duration_cast<duration<double>>(steady_clock::now() - start).count();
+            long long epoch_ms = duration_cast<milliseconds>(
+                system_clock::now().time_since_epoch()).count();
+            cout << fixed << setprecision(3) << elapsed << "," << epoch_ms << "," << p.name
+                 << "," << value << "," << st.kept << "," << st.discarded << ","
+                 << setprecision(0) << mhz << ",";
+            if (isnan(temp)) cout << "n/a";
+            else cout << setprecision(1) << temp;
+            cout << endl;
+        }
+
+        record_metric("core_mhz", "Core frequency of the measuring CPU", {}, mhz);
+        if (!isnan(temp)) record_metric("temperature_celsius", "Hottest thermal zone", {}, temp);
+        write_metrics();
+    }
+
+    // Summary: spread and drift (last tenth vs first tenth) per point
+    cout << "\nPoint       min ns    median ns      max ns    drift%  discarded\n";
+    for (auto& p : points) {
+        if (p.series.empty()) continue;
+        size_t n = p.series.size(), tenth = max<size_t>(1, n / 10);
+        double first = median_of_vector(vector<double>(p.series.begin(), p.series.begin() + tenth));
+        double last  = median_of_vector(vector<double>(p.series.end() - tenth, p.series.end()));
+        cout << left << setw(6) << p.name << right << fixed << setprecision(3)
+             << setw(12) << *min_element(p.series.begin(), p.series.end())
+             << setw(13) << median_of_vector(p.series)
+             << setw(12) << *max_element(p.series.begin(), p.series.end())
+             << setw(10) << setprecision(2) << 100.0 * (last - first) / first
+             << setw(11) << p.discarded << "\n";
+        record_metric("latency_ns", "Pointer-chase latency per cache level",
+                      {{"level", p.name}, {"stat", "median"}}, median_of_vector(p.series));
+        record_metric("latency_drift_percent", "Latency drift from first to last tenth of a soak",
+                      {{"level", p.name}}, 100.0 * (last - first) / first);
+        free(p.chain);
+    }
+    cout << "Lowest frequency: " << setprecision(0) << min_mhz << " MHz";
+    if (!isnan(max_temp)) cout << ", highest temperature: " << setprecision(1) << max_temp << " C";
+    cout << "\n";
+    return 0;
+}
+
+struct L1Detection {
+    size_t line;
+    size_t size;
+    int ways;
+};
+
+L1Detection detect_l1() {
+    cout << "=== L1 Cache Detection ===\n";
+
+    // Fix CPU to reduce jitter
+    runner_place();
+    print_runner_calibration();
+
+    // Initial warm-up of memory subsystem
+    void* buf = allocate_aligned(PAGE_SIZE, BUFFER_SIZE);
+    memset(buf, 0xAA, BUFFER_SIZE);
+    blackhole_ptr(buf);
+
+    size_t line = detect_line_size();
+    size_t l1_raw = detect_l1_size(line);
+    int assoc = detect_associativity(line, l1_raw);
+
+    // Compute number of sets
+    size_t unit = line * assoc;
+    size_t sets = (l1_raw + unit/2) / unit;
+    size_t l1_corrected = sets * unit;
+
+    dummy_sink = dummy_sink ^ (int)line ^ (int)l1_corrected ^ assoc;
+
+    cout << "\n===== FINAL RESULTS =====\n";
+    cout << "Line size: " << line << " bytes\n";
+    cout << "L1 size:   " << l1_corrected/1024 << " KB\n";
+    cout << "Assoc:     " << assoc << " ways\n";
+    cout << "Dummy:     " << dummy_sink << "\n";
+
+    record_metric("line_size_bytes", "Detected cache line size", {{"level", "L1"}}, line);
+    record_metric("cache_size_bytes", "Detected cache capacity", {{"level", "L1"}}, l1_corrected);
+    record_metric("cache_ways", "Detected cache associativity", {{"level", "L1"}}, assoc);
+    return {line, l1_corrected, assoc};
+}
+
+int run_l1_detection() {
+    detect_l1();
+    return 0;
+}
+
+// Latency of a random chain over half of cache level `level`
+double level_latency(int level, size_t level_bytes) {
+    ChainPattern pat{"L" + to_string(level), level_bytes / 2, [](char* mem, size_t bytes) {
+        size_t count = bytes / sizeof(void*);
+        create_random_chain((void**)mem, count);
+        return ChainLayout{(void**)mem, count};
+    }};
+    return measure_pattern(pat, 5).median;
+}
+
+// Write `t` into the shared segment under the sequence lock
+bool publish_topology(const cache_topology& t) {
+    int fd = shm_open(CACHE_TOPOLOGY_SHM_NAME, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) return false;
+    fchmod(fd, 0644);                           // Readable by every local process
+    if (ftruncate(fd, PAGE_SIZE) != 0) { close(fd); return false; }
+    void* map = mmap(nullptr, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    cache_topology* shm = (cache_topology*)map;
+    uint64_t seq = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED) & ~1ull;
+    __atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    size_t seq_off = offsetof(cache_topology, seq);
+    memcpy(shm, &t, seq_off);
+    memcpy((char*)shm + seq_off + sizeof(uint64_t), (const char*)&t + seq_off + sizeof(uint64_t),
+           sizeof(cache_topology) - seq_off - sizeof(uint64_t));
+
+    __atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+    munmap(map, PAGE_SIZE);
+    return true;
+}
+
+// Detect the hierarchy once and publish it for local processes, which map
+// one page through cache_topology.h instead of running detection themselves
+int run_publish_probe() {
+    HostEnvironment env = detect_host_environment();
+    L1Detection l1 = detect_l1();
+
+    cache_topology t;
+    memset(&t, 0, sizeof(t));
+    t.magic = CACHE_TOPOLOGY_MAGIC;
+    t.version = CACHE_TOPOLOGY_VERSION;
+    t.struct_size = sizeof(cache_topology);
+    t.published_unix_ns = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+    t.virtualized = is_virtualized(env);
+
+    cout << "\n=== Publishing topology to /dev/shm" << CACHE_TOPOLOGY_SHM_NAME << " ===\n";
+    for (int level = 1; level <= 3; level++) {
+        cache_topology_level& c = t.levels[t.num_levels++];
+        c.level = level;
+        if (level == 1) {
+            c.flags = CACHE_TOPOLOGY_MEASURED;
+            c.size_bytes = l1.size;
+            c.line_size = (uint32_t)l1.line;
+            c.ways = (uint32_t)l1.ways;
+        } else {
+            c.size_bytes = reported_cache_size(level);
+            c.line_size = (uint32_t)reported_line_size();
+            c.ways = (uint32_t)reported_cache_ways(level);
+        }
+        c.latency_ns = level_latency(level, c.size_bytes);
+        cout << "L" << level << ": " << c.size_bytes / 1024 << " KB, " << c.line_size << " B lines, "
+             << c.ways << " ways, " << fixed << setprecision(3) << c.latency_ns << " ns"
+             << (c.flags & CACHE_TOPOLOGY_MEASURED ? " (measured)" : " (reported)") << "\n";
+    }
+
+    if (!publish_topology(t)) {
+        cout << "Could not publish to /dev/shm" << CACHE_TOPOLOGY_SHM_NAME << "\n";
+        return 1;
+    }
+    cout << "Published version " << CACHE_TOPOLOGY_VERSION << "\n";
+    return 0;
+}
+
+// Print what is currently published, through the same reader other processes use
+int run_topology_reader() {
+    cache_topology t;
+    if (!cache_topology_read(&t)) {
+        cout << "No topology published at /dev/shm" << CACHE_TOPOLOGY_SHM_NAME << "\n";
+        return 1;
+    }
+
+    uint64_t now = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+    cout << "Topology version " << t.version << ", published "
+         << (now - t.published_unix_ns) / 1'000'000'000ull << " s ago"
+         << (t.virtualized ? ", virtual machine" : "") << "\n";
+    for (uint32_t i = 0; i < t.num_levels && i < CACHE_TOPOLOGY_MAX_LEVELS; i++) {
+        const cache_topology_level& c = t.levels[i];
+        cout << "L" << c.level << ": " << c.size_bytes / 1024 << " KB, " << c.line_size
+             << " B lines, " << c.ways << " ways, " << fixed << setprecision(3) << c.latency_ns
+             << " ns" << (c.flags & CACHE_TOPOLOGY_MEASURED ? " (measured)" : "") << "\n";
+    }
+    return 0;
+}
+
+// Allocator layout: the same linked list built by different allocators
+
+const size_t ALLOC_SLAB = 64 * 1024;        // Minimum arena block and pool slab size
+const size_t ALLOC_SLAB_OBJECTS = 16;       // Objects per block when they outgrow ALLOC_SLAB
+
+// Block size holding at least ALLOC_SLAB_OBJECTS objects of n bytes, whole pages
+size_t alloc_slab_bytes(size_t n) {
+    size_t bytes = max(ALLOC_SLAB, n * ALLOC_SLAB_OBJECTS);
+    return (bytes + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+}
+
+// Nodes start with the next pointer, so a list is a chain for measure_chain_latency
+struct AllocNode {
+    AllocNode* next;
+};
+
+// Bump arena: nodes back to back, no per-node header
+struct BumpArena {
+    vector<char*> blocks;
+    char* cur = nullptr;
+    char* end = nullptr;
+
+    void* alloc(size_t n) {
+        n = (n + 15) & ~size_t(15);
+        if (cur + n > end) {
+            size_t bytes = alloc_slab_bytes(n);
+            blocks.push_back((char*)allocate_aligned(PAGE_SIZE, bytes));
+            cur = blocks.back();
+            end = cur + bytes;
+        }
+        void* p = cur;
+        cur += n;
+        return p;
+    }
+    ~BumpArena() { for (char* b : blocks) free(b); }
+};
+
+// Size-class pool: slots rounded up to a power of two, LIFO free list
+struct SizeClassPool {
+    size_t slot;
+    size_t slab_bytes;
+    vector<char*> slabs;
+    void* free_list = nullptr;
+
+    explicit SizeClassPool(size_t n) : slot(16) {
+        while (slot < n) slot *= 2;
+        slab_bytes = alloc_slab_bytes(slot);
+    }
+
+    void* alloc() {
+        if (!free_list) {
+            char* slab = (char*)allocate_aligned(PAGE_SIZE, slab_bytes);
+            slabs.push_back(slab);
+            for (size_t off = slab_bytes; off >= slot; off -= slot) release(slab + off - slot);
+        }
+        void* p = free_list;
+        free_list = *(void**)p;
+        return p;
+    }
+    void release(void* p) {
+        *(void**)p = free_list;
+        free_list = p;
+    }
+    ~SizeClassPool() { for (char* s : slabs) free(s); }
+};
+
+enum class AllocKind { Malloc, Arena, Pool, AgedPool, Fragmented };
+
+const char* alloc_kind_name(AllocKind k) {
+    switch (k) {
+        case AllocKind::Malloc:     return "malloc";
+        case AllocKind::Arena:      return "arena";
+        case AllocKind::Pool:       return "pool";
+        case AllocKind::AgedPool:   return "aged pool";
+        case AllocKind::Fragmented: return "fragmented";
+    }
+    return "?";
+}
+
+// How scattered consecutive nodes are
+struct ListScatter {
+    double near_fraction;     // Hops to the same or the adjacent line
+    double page_fraction;     // Hops within the same 4K page
+    size_t pages;             // Distinct pages the list touches
+};
+
+ListScatter list_scatter(AllocNode* head, size_t count) {
+    size_t near = 0, same_page = 0;
+    vector<uintptr_t> pages;
+    AllocNode* n = head;
+    for (size_t i = 0; i < count; i++) {
+        uintptr_t a = (uintptr_t)n, b = (uintptr_t)n->next;
+        uintptr_t d = a > b ? a - b : b - a;
+        if (d < 128) near++;
+        if ((a >> 12) == (b >> 12)) same_page++;
+        pages.push_back(a >> 12);
+        n = n->next;
+    }
+    sort(pages.begin(), pages.end());
+    size_t distinct = unique(pages.begin(), pages.end()) - pages.begin();
+    return {(double)near / count, (double)same_page / count, distinct};
+}
+
+// Build a circular list of `count` nodes in allocation order and time its traversal
+// Peak heap use of time_allocated_list over all kinds: the fragmented layout's
+// 3 x count fillers of 16..4 x node_bytes (plus malloc headers) dominate, then
+// the aged pool's 2 x count slots
+size_t alloc_list_peak_bytes(size_t count, size_t node_bytes) {
+    size_t slot = 16;
+    while (slot < node_bytes) slot *= 2;
+    size_t nodes = count * (node_bytes + 16);
+    size_t fragmented = 3 * count * ((16 + 4 * node_bytes) / 2 + 16) + nodes;
+    size_t aged = 2 * count * slot + alloc_slab_bytes(slot);
+    return max(fragmented, aged);
+}
+
+SampleStats time_allocated_list(AllocKind kind, size_t count, size_t node_bytes, ListScatter& scatter) {
+    mt19937_64 rng(42);
+    vector<AllocNode*> nodes(count);
+    vector<void*> fillers;
+    BumpArena arena;
+    SizeClassPool pool(node_bytes);
+
+    if (kind == AllocKind::AgedPool) {
+        // Churn: fill twice the slots, then free them in random order
+        vector<void*> slots(2 * count);
+        for (auto& p : slots) p = pool.alloc();
+        shuffle(slots.begin(), slots.end(), rng);
+        for (void* p : slots) pool.release(p);
+    }
+    if (kind == AllocKind::Fragmented) {
+        // Mixed-size allocations, two thirds freed in random order, leave holes for the nodes
+        uniform_int_distribution<size_t> size(16, 4 * node_bytes);
+        vector<void*> all(3 * count);
+        for (auto& p : all) p = malloc(size(rng));
+        shuffle(all.begin(), all.end(), rng);
+        for (size_t i = 0; i < all.size(); i++) {
+            if (i % 3) free(all[i]);
+            else fillers.push_back(all[i]);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        switch (kind) {
+            case AllocKind::Malloc:
+            case AllocKind::Fragmented: nodes[i] = (AllocNode*)malloc(node_bytes); break;
+            case AllocKind::Arena:      nodes[i] = (AllocNode*)arena.alloc(node_bytes); break;
+            case AllocKind::Pool:
+            case AllocKind::AgedPool:   nodes[i] = (AllocNode*)pool.alloc(); break;
+        }
+        memset(nodes[i], 0, node_bytes);
+    }
+    for (size_t i = 0; i < count; i++) nodes[i]->next = nodes[(i + 1) % count];
+
+    scatter = list_scatter(nodes[0], count);
+    SampleStats s;
+    {
+        TraceScope scope(alloc_kind_name(kind), "point");
+        s = sample_chain({(void**)nodes[0], count}, 1, 7);
+    }
+    s.bytes = count * node_bytes;
+
+    if (kind == AllocKind::Malloc || kind == AllocKind::Fragmented)
+        for (AllocNode* n : nodes) free(n);
+    for (void* p : fillers) free(p);
+    return s;
+}
+
+int run_allocator_probe(size_t node_bytes) {
+    cout << "=== Allocator layout and list traversal ===\n";
+    if (node_bytes < sizeof(AllocNode)) node_bytes = 32;
+
+    runner_place();
+    print_runner_calibration();
+
+    const AllocKind kinds[] = {AllocKind::Arena, AllocKind::Malloc, AllocKind::Pool,
+                               AllocKind::AgedPool, AllocKind::Fragmented};
+    struct Level { const char* name; size_t bytes; };
+    const Level levels[] = {{"L1", reported_cache_size(1) / 2}, {"L2", reported_cache_size(2) / 2},
+                            {"L3", reported_cache_size(3) / 2}, {"DRAM", reported_cache_size(3) * 4}};
+
+    cout << "Node size " << node_bytes << " bytes, list linked in allocation order\n";
+    cout << "Level    nodes   allocator        ns/node  x arena   near%   page%     pages\n";
+    for (const Level& lv : levels) {
+        size_t count = max<size_t>(16, lv.bytes / node_bytes);
+        TraceScope scope(lv.name, "phase");
+        double arena_ns = 0;
+        for (AllocKind k : kinds) {
+            string point = string(alloc_kind_name(k)) + " " + lv.name + " nodes=" + to_string(count);
+            vector<double> res = checkpointed(point, 6, [&] {
+                ListScatter sc;
+                SampleStats s = time_allocated_list(k, count, node_bytes, sc);
+                return vector<double>{s.median, (double)s.discarded, sc.near_fraction,
+                                      sc.page_fraction, (double)sc.pages, (double)s.bytes};
+            });
+            SampleStats s;
+            s.median = res[0];
+            s.discarded = (size_t)res[1];
+            ListScatter sc{res[2], res[3], (size_t)res[4]};
+            if (k == AllocKind::Arena) arena_ns = s.median;
+            cout << left << setw(6) << lv.name << right << setw(9) << count << "   "
+                 << left << setw(12) << alloc_kind_name(k) << right << fixed
+                 << setprecision(3) << setw(11) << s.median
+                 << setprecision(2) << setw(9) << s.median / arena_ns
+                 << setprecision(1) << setw(8) << 100 * sc.near_fraction
+                 << setw(8) << 100 * sc.page_fraction << setw(10) << sc.pages;
+            if (s.discarded) cout << "  " << s.discarded << " discarded";
+            cout << endl;
+            record_metric("alloc_traversal_ns", "List traversal latency per node by allocator",
+                          {{"allocator", alloc_kind_name(k)}, {"level", lv.name}}, s.median);
+            record_metric("alloc_scatter_cost_ns", "Traversal latency per node above the bump arena",
+                          {{"allocator", alloc_kind_name(k)}, {"level", lv.name}}, s.median - arena_ns);
+        }
+    }
+    cout << "near%: hops to the same or the adjacent line, page%: hops within one 4K page\n";
+    return 0;
+}
+
+// Bandwidth when only part of each fetched line is used
+
+// Read the first USED bytes of every `stride`-th byte offset; returns a checksum
+template <size_t USED>
+uint64_t read_line_prefixes(const char* buf, size_t bytes, size_t stride) {
+    uint64_t sum = 0;
+    for (size_t off = 0; off < bytes; off += stride) {
+        if constexpr (USED < 8) {
+            sum += *(const uint32_t*)(buf + off);
+        } else {
+            const uint64_t* w = (const uint64_t*)(buf + off);
+            for (size_t i = 0; i < USED / 8; i++) sum += w[i];
+        }
+    }
+    return sum;
+}
+
+// Seconds per pass over `bytes`, median of repeated timed batches
+double time_line_prefix_pass(size_t used, const char* buf, size_t bytes, size_t stride) {
+    auto pass = [&] {
+        switch (used) {
+            case 4:  return read_line_prefixes<4>(buf, bytes, stride);
+            case 8:  return read_line_prefixes<8>(buf, bytes, stride);
+            case 16: return read_line_prefixes<16>(buf, bytes, stride);
+            case 32: return read_line_prefixes<32>(buf, bytes, stride);
+            default: return read_line_prefixes<64>(buf, bytes, stride);
+        }
+    };
+
+    blackhole(pass());                          // Warm-up
+    auto t0 = steady_clock::now();
+    blackhole(pass());
+    double one = duration_cast<duration<double>>(steady_clock::now() - t0).count();
+    size_t passes = max<size_t>(1, (size_t)(runner_calibration().sample_ns * 1e-9 / max(one, 1e-9)));
+
+    vector<double> samples;
+    for (int r = 0; r < 5; r++) {
+        auto start = steady_clock::now();
+        for (size_t p = 0; p < passes; p++) blackhole(pass());
+        samples.push_back(duration_cast<duration<double>>(steady_clock::now() - start).count() / passes);
+    }
+    return median_of_vector(samples);
+}
+
+int run_line_fraction_probe(int every_nth) {
+    cout << "=== Bandwidth vs fraction of each line used ===\n";
+    if (every_nth <= 0) every_nth = 1;
+
+    runner_place();
+    size_t line = reported_line_size();
+    size_t stride = line * every_nth;
+    const size_t used_sizes[] = {4, 8, 16, 32, 64};
+
+    struct Level { const char* name; size_t bytes; };
+    const Level levels[] = {{"L1", reported_cache_size(1) / 2}, {"L2", reported_cache_size(2) / 2},
+                            {"L3", reported_cache_size(3) / 2}, {"DRAM", reported_cache_size(3) * 4}};
+
+    cout << "Line " << line << " bytes, reading every " << every_nth
+         << (every_nth == 1 ? "st" : "th") << " line\n";
+    cout << "Level  Footprint  Used   Useful GB/s   Mlines/s   Fetched GB/s  Efficiency\n";
+    for (const Level& lv : levels) {
+        TraceScope scope(lv.name, "phase");
+        char* buf = (char*)allocate_aligned(PAGE_SIZE, lv.bytes);
+        memset(buf, 1, lv.bytes);
+
+        size_t lines = (lv.bytes + stride - 1) / stride;
+        for (size_t used : used_sizes) {
+            if (used > line) continue;
+            string point = string(lv.name) + " used=" + to_string(used) + " stride=" + to_string(stride);
+            double sec = checkpointed(point, 1, [&] {
+                return vector<double>{time_line_prefix_pass(used, buf, lv.bytes, stride)};
+            })[0];
+            double useful = lines * used / sec;
+            double fetched = lines * line / sec;
+            cout << left << setw(6) << lv.name << right << setw(9) << lv.bytes / 1024 << "K"
+                 << setw(6) << used << fixed << setprecision(2) << setw(14) << useful / 1e9
+                 << setprecision(1) << setw(11) << lines / sec / 1e6
+                 << setprecision(2) << setw(15) << fetched / 1e9
+                 << setprecision(1) << setw(11) << 100.0 * used / line << "%" << endl;
+            record_metric("useful_bandwidth_bytes_per_second",
+                          "Bytes actually used per second when reading a prefix of each line",
+                          {{"level", lv.name}, {"used_bytes", to_string(used)},
+                           {"every_nth", to_string(every_nth)}}, useful);
+            record_metric("line_fetches_per_second", "Cache lines touched per second",
+                          {{"level", lv.name}, {"used_bytes", to_string(used)},
+                           {"every_nth", to_string(every_nth)}}, lines / sec);
+        }
+        free(buf);
+    }
+    cout << "Fetched counts whole lines touched; adjacent-line prefetch can fetch more\n";
+    return 0;
+}
+
+// Timestamp sources: cost per call, resolution, and cost next to a cache miss
+
+struct ClockCost {
+    double call_ns;           // Back-to-back calls
+    double resolution_ns;     // Smallest observed step
+    double miss_extra_ns;     // Added to a dependent DRAM miss
+};
+
+// Ticks of `read` per nanosecond, against steady_clock
+template <class F>
+double ticks_per_ns(F read) {
+    auto t0 = steady_clock::now();
+    uint64_t a = read();
+    this_thread::sleep_for(milliseconds(50));
+    uint64_t b = read();
+    auto t1 = steady_clock::now();
+    return (double)(b - a) / duration_cast<duration<double, nano>>(t1 - t0).count();
+}
+
+template <class F>
+ClockCost time_clock_source(F read, double per_ns, size_t calls, void** chain, size_t chain_count) {
+    ClockCost c;
+    uint64_t sink = 0;
+
+    vector<double> reps;
+    for (int r = 0; r < 5; r++) {
+        auto t0 = steady_clock::now();
+        for (size_t i = 0; i < calls; i++) sink += read();
+        reps.push_back(duration_cast<duration<double, nano>>(steady_clock::now() - t0).count() / calls);
+    }
+    c.call_ns = median_of_vector(reps);
+
+    // Read until the value has changed 20 times, or 100 ms passed
+    c.resolution_ns = 1e18;
+    auto deadline = steady_clock::now() + milliseconds(100);
+    uint64_t last = read();
+    for (int changes = 0; changes < 20 && steady_clock::now() < deadline; ) {
+        uint64_t v = read();
+        if (v != last) {
+            c.resolution_ns = min(c.resolution_ns, (v - last) / per_ns);
+            last = v;
+            changes++;
+        }
+    }
+
+    // Same dependent chase with and without a timestamp per hop
+    const size_t hops = 200'000;
+    vector<double> alone, with;
+    for (int r = 0; r < 5; r++) {
+        alone.push_back(measure_chain_latency(chain, chain_count, hops));
+        void** p = chain;
+        auto t0 = steady_clock::now();
+        for (size_t i = 0; i < hops; i++) {
+            p = (void**)*p;
+            sink += read();
+        }
+        with.push_back(duration_cast<duration<double, nano>>(steady_clock::now() - t0).count() / hops);
+        blackhole_ptr(p);
+    }
+    c.miss_extra_ns = median_of_vector(with) - median_of_vector(alone);
+
+    blackhole(sink);
+    return c;
+}
+
+uint64_t timespec_ns(const timespec& ts) {
+    return (uint64_t)ts.tv_sec * 1'000'000'000ull + ts.tv_nsec;
+}
+
+int run_clock_probe() {
+    cout << "=== Timestamp source cost and resolution ===\n";
+    runner_place();
+
+    string source = read_first_line("/sys/devices/system/clocksource/clocksource0/current_clocksource");
+    cout << "Kernel clocksource: " << (source.empty() ? "unknown" : source) << "\n";
+
+    size_t chain_bytes = reported_cache_size(3) * 4;
+    void** chain = (void**)allocate_aligned(PAGE_SIZE, chain_bytes);
+    size_t chain_count = chain_bytes / sizeof(void*);
+    create_random_chain(chain, chain_count);
+    warmup_chain(chain, chain_count);
+    cout << "Miss chain: " << chain_bytes / (1024 * 1024) << " MB, "
+         << fixed << setprecision(1) << measure_chain_latency(chain, chain_count, 200'000)
+         << " ns per hop\n";
+#if defined(__x86_64__) || defined(__i386__)
+    double tsc_per_ns = ticks_per_ns([] { return (uint64_t)__rdtsc(); });
+    cout << "TSC: " << setprecision(3) << tsc_per_ns << " GHz\n";
+#endif
+
+    cout << "\nSource                           ns/call   resolution ns   +ns per miss   calls/us\n";
+    auto report = [&](const string& name, auto read, double per_ns, size_t calls) {
+        vector<double> v = checkpointed("source=" + name, 3, [&] {
+            ClockCost c = time_clock_source(read, per_ns, calls, chain, chain_count);
+            return vector<double>{c.call_ns, c.resolution_ns, c.miss_extra_ns};
+        });
+        ClockCost c{v[0], v[1], v[2]};
+        cout << left << setw(32) << name << right << fixed << setprecision(1)
+             << setw(8) << c.call_ns << setw(16) << c.resolution_ns
+             << setw(15) << c.miss_extra_ns << setw(11) << 1000.0 / c.call_ns << endl;
+        record_metric("clock_call_ns", "Cost of one timestamp read", {{"source", name}}, c.call_ns);
+        record_metric("clock_resolution_ns", "Smallest observed timestamp step", {{"source", name}},
+                      c.resolution_ns);
+        record_metric("clock_miss_extra_ns", "Timestamp cost added to a dependent DRAM miss",
+                      {{"source", name}}, c.miss_extra_ns);
+    };
+
+#if defined(__x86_64__) || defined(__i386__)
+    {
+        auto rdtsc = [] { return (uint64_t)__rdtsc(); };
+        auto rdtscp = [] { unsigned aux; return (uint64_t)__rdtscp(&aux); };
+        report("rdtsc", rdtsc, tsc_per_ns, 2'000'000);
+        report("rdtscp", rdtscp, tsc_per_ns, 2'000'000);
+        report("rdtscp+lfence (analyzer)", read_timestamp, tsc_per_ns, 2'000'000);
+    }
+#endif
+
+    struct ClockId { const char* name; clockid_t id; };
+    const ClockId ids[] = {
+        {"REALTIME", CLOCK_REALTIME}, {"MONOTONIC", CLOCK_MONOTONIC},
+        {"MONOTONIC_RAW", CLOCK_MONOTONIC_RAW}, {"BOOTTIME", CLOCK_BOOTTIME},
+        {"REALTIME_COARSE", CLOCK_REALTIME_COARSE}, {"MONOTONIC_COARSE", CLOCK_MONOTONIC_COARSE},
+        {"PROCESS_CPUTIME_ID", CLOCK_PROCESS_CPUTIME_ID}, {"THREAD_CPUTIME_ID", CLOCK_THREAD_CPUTIME_ID},
+    };
+    for (const ClockId& c : ids) {
+        timespec res;
+        clock_getres(c.id, &res);
+        auto vdso = [id = c.id] { timespec ts; clock_gettime(id, &ts); return timespec_ns(ts); };
+        auto sys = [id = c.id] { timespec ts; syscall(SYS_clock_gettime, id, &ts); return timespec_ns(ts); };
+        report(string("clock_gettime ") + c.name, vdso, 1.0, 500'000);
+        report(string("  syscall ") + c.name, sys, 1.0, 100'000);
+        cout << "  clock_getres: " << timespec_ns(res) << " ns\n";
+    }
+
+    auto steady = [] { return (uint64_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count(); };
+    auto hires = [] {
+        return (uint64_t)duration_cast<nanoseconds>(high_resolution_clock::now().time_since_epoch()).count();
+    };
+    report("steady_clock::now", steady, 1.0, 500'000);
+    report("high_resolution_clock::now", hires, 1.0, 500'000);
+
+    free(chain);
+    cout << "\n+ns per miss: time a timestamp adds to each hop of a dependent DRAM chase;\n"
+            "serializing reads wait for the miss, others overlap with it\n";
+    return 0;
+}
+
+// Sparse sweeps: one line per page over a large virtual range
+
+// Memory this process may still use: MemAvailable, capped by the cgroup limit
+size_t available_memory_bytes() {
+    size_t avail = SIZE_MAX;
+    ifstream f("/proc/meminfo");
+    string key;
+    size_t kb;
+    while (f >> key >> kb) {
+        if (key == "MemAvailable:") {
+            avail = kb * 1024;
+            break;
+        }
+        f.ignore(256, '\n');
+    }
+
+    string max_s = read_first_line("/sys/fs/cgroup/memory.max");
+    string cur_s = read_first_line("/sys/fs/cgroup/memory.current");
+    if (!max_s.empty() && max_s != "max" && !cur_s.empty()) {
+        size_t limit = stoull(max_s), used = stoull(cur_s);
+        avail = min(avail, limit > used ? limit - used : 0);
+    }
+    return avail;
+}
+
+// One line per page across the range, pages in random order. The line
+// offset moves each time the page index wraps the alias pool, so virtual
+// pages sharing a physical page touch different lines of it
+ChainLayout build_page_spread_chain(char* base, size_t bytes, size_t pool) {
+    size_t pages = bytes / PAGE_SIZE;
+    size_t pool_pages = pool ? pool / PAGE_SIZE : pages;
+    size_t line = reported_line_size();
+    size_t lines_per_page = PAGE_SIZE / line;
+
+    auto point = [&](size_t v) {
+        return base + v * PAGE_SIZE + ((v / pool_pages + v % pool_pages) % lines_per_page) * line;
+    };
+    vector<size_t> order(pages);
+    for (size_t i = 0; i < pages; i++) order[i] = i;
+    mt19937_64 rng(1234567);
+    shuffle(order.begin(), order.end(), rng);
+    for (size_t i = 0; i < pages; i++)
+        *(void**)point(order[i]) = point(order[(i + 1) % pages]);
+    return {(void**)point(order[0]), pages};
+}
+
+int run_sparse_probe(int max_gb, int pool_mb) {
+    cout << "=== Sparse page-spread sweep ===\n";
+    size_t max_span = (max_gb > 0 ? max_gb : 4) * (1ull << 30);
+    size_t pool = (pool_mb > 0 ? pool_mb : 64) * (1ull << 20);
+    size_t lines_per_page = PAGE_SIZE / reported_line_size();
+    size_t memory = available_memory_bytes();
+
+    runner_place();
+    print_runner_calibration();
+
+    // Beyond pool * lines_per_page aliased pages would touch the same line again
+    if (max_span > pool * lines_per_page) {
+        max_span = pool * lines_per_page;
+        cout << "Span capped at " << max_span / (1 << 20) << " MB for a " << (pool >> 20) << " MB pool\n";
+    }
+    cout << "Alias pool " << pool / (1 << 20) << " MB (memfd), " << memory / (1 << 20)
+         << " MB available\n";
+    cout << "    Span      Pages  Line data   Private ns   RSS MB   Aliased ns   RSS MB   Diff%\n";
+
+    for (size_t span = pool; span <= max_span; span *= 2) {
+        size_t pages = span / PAGE_SIZE;
+        string label = to_string(span >> 20) + " MB span";
+        cout << setw(6) << (span >> 20) << "MB" << setw(11) << pages
+             << setw(9) << pages * reported_line_size() / (1 << 20) << "MB" << flush;
+
+        // Private pages: every touched page is resident, so skip what does not fit
+        double priv = 0;
+        if (span <= memory / 2) {
+            ChainPattern pat{label, span, [](char* base, size_t bytes) {
+                return build_page_spread_chain(base, bytes, 0);
+            }};
+            pat.sparse = true;
+            priv = measure_pattern(pat, 5).median;
+            cout << fixed << setprecision(2) << setw(13) << priv << setw(9) << (span >> 20);
+        } else {
+            cout << setw(13) << "skip" << setw(9) << "-";
+        }
+
+        ChainPattern alias{label + " aliased", span, [pool](char* base, size_t bytes) {
+            return build_page_spread_chain(base, bytes, pool);
+        }};
+        alias.alias_bytes = pool;
+        SampleStats a = measure_pattern(alias, 5);
+        if (!a.kept) {
+            cout << setw(13) << "fail" << endl;
+            continue;
+        }
+        cout << fixed << setprecision(2) << setw(13) << a.median << setw(9) << (pool >> 20);
+        if (priv > 0) cout << setprecision(1) << setw(8) << 100 * (a.median - priv) / priv;
+        cout << endl;
+
+        record_metric("sparse_latency_ns", "Latency of a one-line-per-page chain",
+                      {{"span_mb", to_string(span >> 20)}, {"backing", "aliased"}}, a.median);
+        if (priv > 0)
+            record_metric("sparse_latency_ns", "Latency of a one-line-per-page chain",
+                          {{"span_mb", to_string(span >> 20)}, {"backing", "private"}}, priv);
+    }
+
+    cout << "\nAliasing keeps TLB and page-walk behaviour (distinct virtual pages) and\n"
+            "distinct lines up to the pool size, but physical addresses repeat. It can\n"
+            "invalidate:\n"
+            "  - capacity sweeps (l1, bloom, allocator, linefraction): the cached\n"
+            "    working set never exceeds the pool\n"
+            "  - set and slice mapping (linemap, coherence): physical sets repeat\n"
+            "  - DRAM row and bank effects: repeated physical pages hit open rows\n"
+            "  - prefetcher studies: physically adjacent lines belong to far virtual pages\n"
+            "It is safe for TLB and paging-structure probes (paging, virt).\n";
+    return 0;
+}
+
+// Read/write mix bandwidth
+
+const size_t RW_BLOCK_LINES = 8;             // Lines per read or write unit of the ratio
+
+// One pass: in every group of reads + writes blocks, read the first `reads`
+// blocks and overwrite the rest; returns a checksum of what was read
+uint64_t rw_mix_pass(char* buf, size_t bytes, size_t line, int reads, int writes, uint64_t v) {
+    size_t block = RW_BLOCK_LINES * line;
+    size_t group = (size_t)(reads + writes) * block;
+    size_t read_words = reads * block / sizeof(uint64_t);
+    size_t write_words = writes * block / sizeof(uint64_t);
+    uint64_t sum = 0;
+    for (size_t g = 0; g + group <= bytes; g += group) {
+        const uint64_t* rd = (const uint64_t*)(buf + g);
+        for (size_t i = 0; i < read_words; i++) sum += rd[i];
+        uint64_t* wr = (uint64_t*)(buf + g + reads * block);
+        for (size_t i = 0; i < write_words; i++) wr[i] = v;
+    }
+    return sum;
+}
+
+// Bytes per second over all threads; each thread owns `per_thread` bytes
+double rw_mix_bandwidth(int threads, const vector<int>& cpus, size_t per_thread,
+                        int reads, int writes) {
+    size_t line = reported_line_size();
+    vector<char*> bufs(threads);
+    for (auto& b : bufs) {
+        b = (char*)allocate_aligned(PAGE_SIZE, per_thread);
+        memset(b, 1, per_thread);
+    }
+    size_t group = (size_t)(reads + writes) * RW_BLOCK_LINES * line;
+    size_t moved = per_thread / group * group;  // Bytes one pass reads or writes
+
+    // Passes per sample from a single-threaded pilot
+    auto t0 = steady_clock::now();
+    blackhole(rw_mix_pass(bufs[0], per_thread, line, reads, writes, 2));
+    double one = duration_cast<duration<double>>(steady_clock::now() - t0).count();
+    size_t passes = max<size_t>(1, (size_t)(runner_calibration().sample_ns * 1e-9 / max(one, 1e-9)));
+
+    vector<double> rates;
+    for (int rep = 0; rep < 5; rep++) {
+        double secs = run_pinned_threads(threads, cpus, [&](int t) {
+            uint64_t sum = 0;
+            for (size_t p = 0; p < passes; p++)
+                sum += rw_mix_pass(bufs[t], per_thread, line, reads, writes, p);
+            blackhole(sum);
+        });
+        rates.push_back((double)moved * passes * threads / secs);
+    }
+    for (char* b : bufs) free(b);
+    return median_of_vector(rates);
+}
+
+int run_rw_mix_probe() {
+    cout << "=== Read/write mix bandwidth ===\n";
+    runner_place();
+
+    vector<int> cpus = available_cpus();
+    int all = (int)cpus.size();
+    struct Ratio { const char* name; int reads, writes; };
+    const Ratio ratios[] = {{"1:0", 1, 0}, {"3:1", 3, 1}, {"2:1", 2, 1}, {"1:1", 1, 1}, {"0:1", 0, 1}};
+    struct Level { const char* name; size_t bytes; bool shared; };
+    const Level levels[] = {{"L1", reported_cache_size(1) / 2, false},
+                            {"L2", reported_cache_size(2) / 2, false},
+                            {"L3", reported_cache_size(3) / 2, true},
+                            {"DRAM", reported_cache_size(3) * 4, true}};
+
+    cout << "GB/s read+written by the program (write-allocate traffic not counted)\n";
+    cout << "Level  Threads";
+    for (const Ratio& r : ratios) cout << setw(9) << r.name;
+    cout << "   1:1 vs 1:0\n";
+
+    for (const Level& lv : levels) {
+        for (int threads : all > 1 ? vector<int>{1, all} : vector<int>{1}) {
+            TraceScope scope(string(lv.name) + " x" + to_string(threads), "point");
+            // Private levels: a working set per core; shared ones are split between threads
+            size_t per_thread = lv.shared ? lv.bytes / threads : lv.bytes;
+            per_thread = max(per_thread / PAGE_SIZE * PAGE_SIZE, PAGE_SIZE);
+
+            cout << left << setw(7) << lv.name << right << setw(7) << threads << flush;
+            double bw[5];
+            for (int r = 0; r < 5; r++) {
+                string point = string(lv.name) + " ratio=" + ratios[r].name + " threads=" + to_string(threads);
+                bw[r] = checkpointed(point, 1, [&] {
+                    return vector<double>{rw_mix_bandwidth(threads, cpus, per_thread,
+                                                           ratios[r].reads, ratios[r].writes)};
+                })[0];
+                cout << fixed << setprecision(1) << setw(9) << bw[r] / 1e9 << flush;
+                record_metric("rw_mix_bandwidth_bytes_per_second",
+                              "Bandwidth by read:write line ratio",
+                              {{"level", lv.name}, {"ratio", ratios[r].name},
+                               {"threads", to_string(threads)}}, bw[r]);
+            }
+            cout << setw(12) << setprecision(0) << 100 * bw[3] / bw[0] << "%" << endl;
+        }
+    }
+    return 0;
+}
+
+// Thread placement advisor
+
+// CPUs for `threads` threads: one CPU from each group in turn, groups and
+// the CPUs within them in compact order (node, package, LLC, L2, core)
+vector<int> spread_over(vector<CpuPlace> places, int threads, function<int(const CpuPlace&)> key) {
+    sort(places.begin(), places.end(), [](const CpuPlace& a, const CpuPlace& b) {
+        return tie(a.node, a.package, a.l3, a.l2, a.core, a.cpu) <
+               tie(b.node, b.package, b.l3, b.l2, b.core, b.cpu);
+    });
+    vector<int> keys;
+    map<int, vector<int>> groups;
+    for (const CpuPlace& p : places) {
+        int k = key(p);
+        if (!groups.count(k)) keys.push_back(k);
+        groups[k].push_back(p.cpu);
+    }
+
+    vector<int> order;
+    for (size_t rank = 0; order.size() < places.size(); rank++)
+        for (int k : keys)
+            if (rank < groups[k].size()) order.push_back(groups[k][rank]);
+
+    vector<int> cpus;
+    for (int t = 0; t < threads; t++) cpus.push_back(order[t % order.size()]);
+    return cpus;
+}
+
+struct PlacementResult {
+    double throughput;        // Operations per second over all threads
+    double p50_ns, p99_ns;    // Time per hop (chase) or per 64 bytes (stream) of a chunk
+};
+
+const size_t PLACE_CHUNK_HOPS = 1024;        // Chase: hops per timed chunk
+const size_t PLACE_CHUNK_BYTES = 64 * 1024;  // Stream: bytes per timed chunk
+const double PLACE_RUN_SECONDS = 0.2;
+
+// Run the kernel on one thread per entry of `cpus`; each thread first-touches its own buffer
+PlacementResult run_placement(const vector<int>& cpus, bool chase, size_t ws) {
+    int n = (int)cpus.size();
+    vector<char*> bufs(n);
+    run_pinned_threads(n, cpus, [&](int t) {
+        bufs[t] = (char*)allocate_aligned(PAGE_SIZE, ws);
+        if (chase) create_random_chain((void**)bufs[t], ws / sizeof(void*));
+        else memset(bufs[t], 1, ws);
+    });
+
+    vector<vector<double>> chunks(n);
+    vector<double> ops(n, 0);
+    double wall = run_pinned_threads(n, cpus, [&](int t) {
+        auto start = steady_clock::now();
+        void** p = (void**)bufs[t];
+        size_t off = 0;
+        uint64_t sum = 0;
+        while (duration_cast<duration<double>>(steady_clock::now() - start).count() < PLACE_RUN_SECONDS) {
+            auto c0 = steady_clock::now();
+            if (chase) {
+                for (size_t i = 0; i < PLACE_CHUNK_HOPS; i++) p = (void**)*p;
+            } else {
+                const uint64_t* w = (const uint64_t*)(bufs[t] + off);
+                for (size_t i = 0; i < PLACE_CHUNK_BYTES / 8; i++) sum += w[i];
+                off = (off + PLACE_CHUNK_BYTES) % (ws / PLACE_CHUNK_BYTES * PLACE_CHUNK_BYTES);
+            }
+            double ns = duration_cast<duration<double, nano>>(steady_clock::now() - c0).count();
+            chunks[t].push_back(ns / (chase ? PLACE_CHUNK_HOPS : PLACE_CHUNK_BYTES / 64));
+            ops[t] += chase ? PLACE_CHUNK_HOPS : PLACE_CHUNK_BYTES;
+        }
+        blackhole_ptr(p);
+        blackhole(sum);
+    });
+    for (char* b : bufs) free(b);
+
+    vector<double> all;
+    for (auto& c : chunks) all.insert(all.end(), c.begin(), c.end());
+    sort(all.begin(), all.end());
+    double total = 0;
+    for (double o : ops) total += o;
+    return {total / wall, all[all.size() / 2], all[min(all.size() - 1, all.size() * 99 / 100)]};
+}
+
+int run_placement_probe(int threads, const string& kernel, size_t ws_kb) {
+    cout << "=== Thread placement advisor ===\n";
+    vector<CpuPlace> places = cpu_places();
+    if (threads <= 0) threads = max<int>(1, places.size() / 2);
+    bool chase = kernel != "stream";
+    size_t ws = ws_kb ? ws_kb * 1024 : reported_cache_size(3);
+    ws = max(ws / PAGE_SIZE * PAGE_SIZE, PLACE_CHUNK_BYTES);
+
+    auto count = [&](function<int(const CpuPlace&)> key) {
+        vector<int> k;
+        for (auto& p : places) k.push_back(key(p));
+        sort(k.begin(), k.end());
+        return unique(k.begin(), k.end()) - k.begin();
+    };
+    cout << places.size() << " CPUs, " << count([](auto& p) { return p.core; }) << " cores, "
+         << count([](auto& p) { return p.l2; }) << " L2 domains, "
+         << count([](auto& p) { return p.l3; }) << " LLC domains, "
+         << count([](auto& p) { return p.node; }) << " NUMA nodes\n";
+    cout << threads << " threads, kernel " << (chase ? "chase" : "stream") << ", "
+         << ws / 1024 << " KB per thread, op = " << (chase ? "one hop" : "64 bytes") << "\n\n";
+
+    struct Placement { const char* name; function<int(const CpuPlace&)> key; };
+    const Placement placements[] = {
+        {"compact", [](const CpuPlace&) { return 0; }},
+        {"per-core", [](const CpuPlace& p) { return p.core; }},
+        {"per-L2", [](const CpuPlace& p) { return p.l2; }},
+        {"per-LLC", [](const CpuPlace& p) { return p.l3; }},
+        {"per-node", [](const CpuPlace& p) { return p.node; }},
+    };
+
+    const char* unit = chase ? "Mhops/s" : "GB/s";
+    cout << "Placement   " << setw(12) << unit << setw(12) << "p50 ns/op" << setw(12) << "p99 ns/op"
+         << "  CPUs\n";
+
+    vector<pair<vector<int>, PlacementResult>> results;
+    for (const Placement& pl : placements) {
+        vector<int> cpus = spread_over(places, threads, pl.key);
+        TraceScope scope(pl.name, "point");
+
+        string point = string(pl.name) + " cpus=" + cpu_list_string(cpus) + " kernel=" +
+                       (chase ? "chase" : "stream") + " ws=" + to_string(ws);
+        vector<double> saved = checkpointed(point, 3, [&] {
+            vector<PlacementResult> reps;
+            for (int r = 0; r < 3; r++) reps.push_back(run_placement(cpus, chase, ws));
+            sort(reps.begin(), reps.end(), [](auto& a, auto& b) { return a.throughput < b.throughput; });
+            return vector<double>{reps[1].throughput, reps[1].p50_ns, reps[1].p99_ns};
+        });
+        PlacementResult res{saved[0], saved[1], saved[2]};
+        results.push_back({cpus, res});
+
+        string list = cpu_list_string(cpus);
+        cout << left << setw(12) << pl.name << right << fixed << setprecision(2)
+             << setw(12) << res.throughput / (chase ? 1e6 : 1e9)
+             << setw(12) << res.p50_ns << setw(12) << res.p99_ns << "  " << list << endl;
+        vector<pair<string, string>> labels = {{"placement", pl.name}, {"threads", to_string(threads)},
+                                               {"kernel", chase ? "chase" : "stream"}};
+        if (chase)
+            record_metric("placement_hops_per_second", "Chase throughput by thread placement", labels,
+                          res.throughput);
+        else
+            record_metric("placement_bytes_per_second", "Stream bandwidth by thread placement", labels,
+                          res.throughput);
+        record_metric("placement_p50_ns", "Median time per operation by thread placement", labels, res.p50_ns);
+        record_metric("placement_p99_ns", "99th percentile time per operation by thread placement",
+                      labels, res.p99_ns);
+    }
+
+    // Best throughput; within 5% of it the lower tail wins
+    double best_tp = 0;
+    for (auto& r : results) best_tp = max(best_tp, r.second.throughput);
+    size_t best = 0;
+    for (size_t i = 0; i < results.size(); i++)
+        if (results[i].second.throughput >= 0.95 * best_tp &&
+            (results[best].second.throughput < 0.95 * best_tp ||
+             results[i].second.p99_ns < results[best].second.p99_ns))
+            best = i;
+
+    vector<int> cpus = results[best].first;
+    vector<int> set = cpus;
+    sort(set.begin(), set.end());
+    set.erase(unique(set.begin(), set.end()), set.end());
+    string list = cpu_list_string(set);
+
+    cout << "\nRecommended: " << placements[best].name << ", affinity mask 0x"
+         << cpu_mask_string(set) << " (taskset -c " << list << ")\n";
+    cout << "Per-thread pinning:";
+    for (size_t t = 0; t < cpus.size(); t++) cout << " " << t << "->" << cpus[t];
+    cout << "\n";
+    return 0;
+}
+
+// hwloc-style topology export with measured attributes
+
+// One-way latency of a cache line handed back and forth between two CPUs
+double core_to_core_ns(int a, int b, int round_trips) {
+    alignas(64) atomic<int> turn{0};
+    double secs = run_pinned_threads(2, {a, b}, [&](int t) {
+        for (int i = 0; i < round_trips; i++) {
+            while (turn.load(memory_order_acquire) != 2 * i + t) {}
+            turn.store(2 * i + t + 1, memory_order_release);
+        }
+    });
+    return secs * 1e9 / round_trips / 2;
+}
+
+struct TopoObject {
+    string type;
+    int os_index = -1;
+    vector<int> cpus;
+    vector<pair<string, string>> attrs;   // Extra attributes, hwloc names
+    vector<pair<string, string>> info;    // <info name= value=/>
+    vector<TopoObject> children;
+};
+
+TopoObject topo_object(const string& type, int os_index, const vector<int>& cpus) {
+    return {type, os_index, cpus, {}, {}, {}};
+}
+
+// hwloc bitmap: 32-bit groups, "0x" each, most significant first
+string hwloc_cpuset(const vector<int>& cpus) {
+    int top = cpus.empty() ? 0 : *max_element(cpus.begin(), cpus.end());
+    vector<uint32_t> words(top / 32 + 1, 0);
+    for (int c : cpus) words[c / 32] |= 1u << (c % 32);
+    ostringstream out;
+    for (size_t i = words.size(); i-- > 0;)
+        out << "0x" << hex << setfill('0') << setw(8) << words[i] << (i ? "," : "");
+    return out.str();
+}
+
+void write_topo_xml(ostream& out, const TopoObject& o, int indent) {
+    string pad(indent * 2, ' ');
+    out << pad << "<object type=\"" << o.type << "\"";
+    if (o.os_index >= 0) out << " os_index=\"" << o.os_index << "\"";
+    out << " cpuset=\"" << hwloc_cpuset(o.cpus) << "\" complete_cpuset=\"" << hwloc_cpuset(o.cpus) << "\"";
+    for (auto& [k, v] : o.attrs) out << " " << k << "=\"" << v << "\"";
+    if (o.info.empty() && o.children.empty()) {
+        out << "/>\n";
+        return;
+    }
+    out << ">\n";
+    for (auto& [k, v] : o.info) out << pad << "  <info name=\"" << k << "\" value=\"" << v << "\"/>\n";
+    for (const TopoObject& c : o.children) write_topo_xml(out, c, indent + 1);
+    out << pad << "</object>\n";
+}
+
+void write_topo_json(ostream& out, const TopoObject& o, int indent) {
+    string pad(indent * 2, ' ');
+    out << pad << "{\"type\": \"" << o.type << "\"";
+    if (o.os_index >= 0) out << ", \"os_index\": " << o.os_index;
+    out << ", \"cpuset\": \"" << hwloc_cpuset(o.cpus) << "\"";
+    for (auto& [k, v] : o.attrs) out << ", \"" << k << "\": \"" << json_escape(v) << "\"";
+    if (!o.info.empty()) {
+        out << ", \"info\": {";
+        for (size_t i = 0; i < o.info.size(); i++)
+            out << (i ? ", " : "") << "\"" << o.info[i].first << "\": \"" << json_escape(o.info[i].second) << "\"";
+        out << "}";
+    }
+    if (!o.children.empty()) {
+        out << ", \"children\": [\n";
+        for (size_t i = 0; i < o.children.size(); i++) {
+            write_topo_json(out, o.children[i], indent + 1);
+            out << (i + 1 < o.children.size() ? ",\n" : "\n");
+        }
+        out << pad << "]";
+    }
+    out << "}";
+}
+
+// Cache object for `level` with measured values where we have them
+TopoObject cache_object(int level, const vector<int>& cpus, const L1Detection& l1,
+                        const vector<double>& latency) {
+    TopoObject o = topo_object("L" + to_string(level) + "Cache", -1, cpus);
+    bool measured = level == 1;
+    size_t size = measured ? l1.size : reported_cache_size(level);
+    size_t line = measured ? l1.line : reported_line_size();
+    size_t ways = measured ? l1.ways : reported_cache_ways(level);
+    o.attrs = {{"cache_size", to_string(size)}, {"depth", to_string(level)},
+               {"cache_linesize", to_string(line)}, {"cache_associativity", to_string(ways)},
+               {"cache_type", level == 1 ? "1" : "0"}};
+    ostringstream lat;
+    lat << fixed << setprecision(3) << latency[level - 1];
+    o.info = {{"cache_analyzer:latency_ns", lat.str()},
+              {"cache_analyzer:source", measured ? "measured" : "reported"}};
+    return o;
+}
+
+int run_export_probe(const string& path) {
+    cout << "=== Topology export ===\n";
+    bool json = path.size() >= 5 && path.substr(path.size() - 5) == ".json";
+
+    vector<CpuPlace> places = cpu_places();
+    sort(places.begin(), places.end(), [](const CpuPlace& a, const CpuPlace& b) {
+        return tie(a.package, a.l3, a.l2, a.core, a.cpu) < tie(b.package, b.l3, b.l2, b.core, b.cpu);
+    });
+    auto cpus_where = [&](function<bool(const CpuPlace&)> pred) {
+        vector<int> out;
+        for (auto& p : places) if (pred(p)) out.push_back(p.cpu);
+        return out;
+    };
+    // Distinct values of `key` among places matching `pred`, in topology order
+    auto distinct = [&](function<bool(const CpuPlace&)> pred, function<int(const CpuPlace&)> key) {
+        vector<int> out;
+        for (auto& p : places)
+            if (pred(p) && find(out.begin(), out.end(), key(p)) == out.end()) out.push_back(key(p));
+        return out;
+    };
+
+    // Core-to-core matrix over the first PU of every core. Measured before
+    // detect_l1(), which pins the process to a single CPU.
+    vector<int> cores = distinct([](auto&) { return true; }, [](auto& p) { return p.core; });
+    size_t n = cores.size();
+    vector<double> matrix(n * n, 0);
+    cout << "\nCore-to-core one-way latency (ns) over " << n << " cores\n";
+    {
+        TraceScope scope("core_to_core", "phase");
+        for (size_t i = 0; i < n; i++)
+            for (size_t j = i + 1; j < n; j++)
+                matrix[i * n + j] = matrix[j * n + i] =
+                    checkpointed("c2c/" + to_string(cores[i]) + "/" + to_string(cores[j]), 1, [&] {
+                        return vector<double>{core_to_core_ns(cores[i], cores[j], 5000)};
+                    })[0];
+    }
+    if (n <= 16) {
+        cout << "      ";
+        for (int c : cores) cout << setw(7) << c;
+        cout << "\n";
+        for (size_t i = 0; i < n; i++) {
+            cout << setw(6) << cores[i];
+            for (size_t j = 0; j < n; j++) cout << setw(7) << fixed << setprecision(1) << matrix[i * n + j];
+            cout << "\n";
+        }
+    }
+
+    L1Detection l1 = detect_l1();
+    vector<double> latency;
+    for (int level = 1; level <= 3; level++)
+        latency.push_back(level_latency(level, level == 1 ? l1.size : reported_cache_size(level)));
+
+    TopoObject machine = topo_object("Machine", 0, cpus_where([](auto&) { return true; }));
+    machine.info = {{"Backend", "cache_analyzer"}, {"cache_analyzer:line_size_measured", to_string(l1.line)}};
+    for (int pkg : distinct([](auto&) { return true; }, [](auto& p) { return p.package; })) {
+        auto in_pkg = [pkg](const CpuPlace& p) { return p.package == pkg; };
+        TopoObject package = topo_object("Package", pkg, cpus_where(in_pkg));
+
+        for (int node : distinct(in_pkg, [](auto& p) { return p.node; })) {
+            TopoObject numa = topo_object("NUMANode", node, cpus_where([node](auto& p) { return p.node == node; }));
+            string mem = read_first_line("/sys/devices/system/node/node" + to_string(node) + "/meminfo");
+            size_t kb = 0;
+            if (sscanf(mem.c_str(), "Node %*d MemTotal: %zu", &kb) == 1)
+                numa.attrs.push_back({"local_memory", to_string(kb * 1024)});
+            package.children.push_back(numa);
+        }
+        for (int l3 : distinct(in_pkg, [](auto& p) { return p.l3; })) {
+            auto in_l3 = [&](const CpuPlace& p) { return in_pkg(p) && p.l3 == l3; };
+            TopoObject l3o = cache_object(3, cpus_where(in_l3), l1, latency);
+            for (int l2 : distinct(in_l3, [](auto& p) { return p.l2; })) {
+                auto in_l2 = [&](const CpuPlace& p) { return in_l3(p) && p.l2 == l2; };
+                TopoObject l2o = cache_object(2, cpus_where(in_l2), l1, latency);
+                for (int core : distinct(in_l2, [](auto& p) { return p.core; })) {
+                    auto in_core = [&](const CpuPlace& p) { return in_l2(p) && p.core == core; };
+                    TopoObject l1o = cache_object(1, cpus_where(in_core), l1, latency);
+                    TopoObject c = topo_object("Core", core, cpus_where(in_core));
+                    for (int pu : c.cpus) c.children.push_back(topo_object("PU", pu, {pu}));
+                    l1o.children.push_back(c);
+                    l2o.children.push_back(l1o);
+                }
+                l3o.children.push_back(l2o);
+            }
+            package.children.push_back(l3o);
+        }
+        machine.children.push_back(package);
+    }
+
+    ofstream f(path);
+    if (!f) {
+        cout << "Could not write " << path << "\n";
+        return 1;
+    }
+    if (json) {
+        f << "{\"format\": \"cache_analyzer-topology\", \"version\": 1,\n\"topology\":\n";
+        write_topo_json(f, machine, 0);
+        f << ",\n\"distances\": {\"name\": \"CoreToCoreLatencyNs\", \"type\": \"PU\", \"indexes\": [";
+        for (size_t i = 0; i < n; i++) f << (i ? ", " : "") << cores[i];
+        f << "],\n  \"values\": [";
+        for (size_t i = 0; i < n * n; i++) f << (i ? ", " : "") << fixed << setprecision(1) << matrix[i];
+        f << "]}}\n";
+    } else {
+        // Distances are hwloc "from user, means latency" (kind 6), values in ns
+        f << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<!DOCTYPE topology SYSTEM \"hwloc2.dtd\">\n"
+          << "<topology version=\"2.0\">\n";
+        write_topo_xml(f, machine, 1);
+        f << "  <distances2 type=\"PU\" nbobjs=\"" << n << "\" kind=\"6\" name=\"CoreToCoreLatencyNs\""
+          << " indexing=\"os\">\n    <indexes length=\"" << n << "\">";
+        for (size_t i = 0; i < n; i++) f << (i ? " " : "") << cores[i];
+        f << "</indexes>\n    <u64values length=\"" << n * n << "\">";
+        for (size_t i = 0; i < n * n; i++) f << (i ? " " : "") << llround(matrix[i]);
+        f << "</u64values>\n  </distances2>\n</topology>\n";
+    }
+    cout << "Topology written to " << path << "\n";
+    return 0;
+}
+
+// Struct layout evaluator: false sharing of a described struct
+
+// One line of the description: name offset size threads op rate
+struct FieldSpec {
+    string name;
+    size_t offset = 0, size = 8;
+    vector<int> threads;      // Empty: every thread
+    bool reads = false, writes = false;
+    int rate = 1;             // Accesses per round, relative to the other fields
+};
+
+// "# comment" lines and blank lines are skipped; threads is a list like
+// 0,2-3 or * for all; op is r, w or rw (read-modify-write)
+// `thread_arg` (0: none) sets how many threads `*` stands for; without it a
+// "threads N" line does, and failing both every available CPU
+bool parse_layout(istream& in, int thread_arg, vector<FieldSpec>& fields, int& threads, string& err) {
+    string line;
+    int line_no = 0;
+    int listed = 1, declared = 0;
+    bool star = false, star_writes = false;
+    while (getline(in, line)) {
+        line_no++;
+        line = line.substr(0, line.find('#'));
+        stringstream ss(line);
+        FieldSpec f;
+        string who, op;
+        if (!(ss >> f.name)) continue;
+        if (f.name == "threads" && ss >> declared && !(ss >> who)) {
+            if (declared < 1) {
+                err = "line " + to_string(line_no) + ": threads must be at least 1";
+                return false;
+            }
+            continue;
+        }
+        if (!(ss >> f.offset >> f.size >> who >> op)) {
+            err = "line " + to_string(line_no) + ": expected name offset size threads op [rate]";
+            return false;
+        }
+        ss >> f.rate;
+        if (f.size == 0 || f.rate <= 0 || (op != "r" && op != "w" && op != "rw")) {
+            err = "line " + to_string(line_no) + ": bad size, rate or op '" + op + "'";
+            return false;
+        }
+        f.reads = op != "w";
+        f.writes = op != "r";
+        if (who != "*") f.threads = parse_cpu_list(who);
+        star |= f.threads.empty();
+        star_writes |= f.threads.empty() && f.writes;
+        for (int t : f.threads) listed = max(listed, t + 1);
+        fields.push_back(f);
+    }
+    if (fields.empty()) {
+        err = "no fields";
+        return false;
+    }
+    int all = thread_arg > 0 ? thread_arg : declared > 0 ? declared : star ? (int)available_cpus().size() : 1;
+    threads = max(listed, all);
+    if (star_writes && threads < 2) {
+        err = "'*' fields are written but only one thread runs; add 'threads N' or pass a thread count";
+        return false;
+    }
+    return true;
+}
+
+bool field_used_by(const FieldSpec& f, int t) {
+    return f.threads.empty() || find(f.threads.begin(), f.threads.end(), t) != f.threads.end();
+}
+
+// Threads that write the field, as a sorted list (all threads for "*")
+vector<int> field_writers(const FieldSpec& f, int threads) {
+    vector<int> w;
+    if (f.writes)
+        for (int t = 0; t < threads; t++)
+            if (field_used_by(f, t)) w.push_back(t);
+    return w;
+}
+
+// Lines written by more than one thread: false sharing when the fields on
+// the line have different writers, true sharing when they all share them
+vector<string> false_sharing_report(const vector<FieldSpec>& fields, int threads, size_t line) {
+    map<size_t, vector<const FieldSpec*>> lines;
+    for (const FieldSpec& f : fields)
+        for (size_t l = f.offset / line; l <= (f.offset + f.size - 1) / line; l++)
+            lines[l].push_back(&f);
+
+    vector<string> out;
+    for (auto& [l, on_line] : lines) {
+        vector<int> writers;
+        bool same = true;
+        for (const FieldSpec* f : on_line) {
+            vector<int> w = field_writers(*f, threads);
+            if (w != field_writers(*on_line[0], threads)) same = false;
+            for (int t : w)
+                if (find(writers.begin(), writers.end(), t) == writers.end()) writers.push_back(t);
+        }
+        if (writers.size() < 2) continue;
+
+        sort(writers.begin(), writers.end());
+        ostringstream s;
+        s << "line " << l << ": ";
+        for (size_t i = 0; i < on_line.size(); i++) s << (i ? ", " : "") << on_line[i]->name;
+        s << ", writers";
+        for (int t : writers) s << " " << t;
+        s << (same ? " (true sharing)" : " (false sharing)");
+        out.push_back(s.str());
+    }
+    return out;
+}
+
+// Same fields regrouped: one line group per single writer thread, shared
+// written fields on a line each, read-only fields together
+vector<FieldSpec> padded_layout(vector<FieldSpec> fields, int threads, size_t line) {
+    map<string, vector<size_t>> groups;   // Group key -> field indexes, in description order
+    vector<string> order;
+    for (size_t i = 0; i < fields.size(); i++) {
+        vector<int> w = field_writers(fields[i], threads);
+        string key = w.empty() ? "read-only" : w.size() == 1 ? "writer " + to_string(w[0])
+                                                             : "shared " + fields[i].name;
+        if (!groups.count(key)) order.push_back(key);
+        groups[key].push_back(i);
+    }
+    size_t off = 0;
+    for (const string& key : order) {
+        off = (off + line - 1) / line * line;
+        for (size_t i : groups[key]) {
+            size_t align = 1;
+            while (align < fields[i].size && align < 8) align *= 2;
+            off = (off + align - 1) / align * align;
+            fields[i].offset = off;
+            off += fields[i].size;
+        }
+    }
+    return fields;
+}
+
+size_t layout_bytes(const vector<FieldSpec>& fields) {
+    size_t end = 0;
+    for (const FieldSpec& f : fields) end = max(end, f.offset + f.size);
+    return end;
+}
+
+inline void touch_field(char* p, size_t size, bool reads, bool writes) {
+    if (size >= 8) {
+        for (size_t i = 0; i + 8 <= size; i += 8) {
+            volatile uint64_t* q = (volatile uint64_t*)(p + i);
+            if (reads && writes) *q = *q + 1;
+            else if (writes) *q = i;
+            else blackhole(*q);
+        }
+    } else {
+        volatile uint8_t* q = (volatile uint8_t*)p;
+        if (reads && writes) *q = *q + 1;
+        else if (writes) *q = 1;
+        else blackhole(*q);
+    }
+}
+
+// Accesses per second of each thread running its fields' accesses for a fixed time
+vector<double> run_layout(const vector<FieldSpec>& fields, int threads, const vector<int>& cpus) {
+    size_t bytes = (layout_bytes(fields) + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    char* mem = (char*)allocate_aligned(PAGE_SIZE, bytes);
+    memset(mem, 0, bytes);
+
+    vector<double> rates(threads, 0);
+    run_pinned_threads(threads, cpus, [&](int t) {
+        vector<const FieldSpec*> mine;
+        size_t per_round = 0;
+        for (const FieldSpec& f : fields)
+            if (field_used_by(f, t)) {
+                mine.push_back(&f);
+                per_round += f.rate;
+            }
+        if (mine.empty()) return;
+
+        auto start = steady_clock::now();
+        size_t rounds = 0;
+        double secs = 0;
+        while (secs < 0.3) {
+            for (int r = 0; r < 1024; r++)
+                for (const FieldSpec* f : mine)
+                    for (int k = 0; k < f->rate; k++)
+                        touch_field(mem + f->offset, f->size, f->reads, f->writes);
+            rounds += 1024;
+            secs = duration_cast<duration<double>>(steady_clock::now() - start).count();
+        }
+        rates[t] = rounds * per_round / secs;
+    });
+    free(mem);
+    return rates;
+}
+
+void print_layout(const vector<FieldSpec>& fields, size_t line) {
+    for (const FieldSpec& f : fields)
+        cout << "  " << left << setw(20) << f.name << right << setw(6) << f.offset << setw(5) << f.size
+             << "   line " << f.offset / line << "\n";
+}
+
+int run_layout_probe(const string& path, int thread_arg) {
+    cout << "=== Struct layout false-sharing evaluator ===\n";
+    vector<FieldSpec> fields;
+    int threads;
+    string err;
+    bool ok;
+    if (path.empty() || path == "-") {
+        ok = parse_layout(cin, thread_arg, fields, threads, err);
+    } else {
+        ifstream in(path);
+        if (!in) {
+            cout << "Cannot read " << path << "\n";
+            return 1;
+        }
+        ok = parse_layout(in, thread_arg, fields, threads, err);
+    }
+    if (!ok) {
+        cout << "Bad layout: " << err << "\n";
+        return 1;
+    }
+
+    vector<int> cpus = available_cpus();        // Before detection pins the process
+    runner_place();
+    size_t line = detect_line_size();
+    if ((int)cpus.size() < threads)
+        cout << "warning: " << threads << " threads on " << cpus.size()
+             << " CPUs, threads share cores and false sharing is understated\n";
+
+    vector<FieldSpec> padded = padded_layout(fields, threads, line);
+    struct Variant { const char* name; const vector<FieldSpec>* fields; };
+    const Variant variants[] = {{"as given", &fields}, {"padded", &padded}};
+
+    vector<double> totals;
+    for (const Variant& v : variants) {
+        cout << "\nLayout " << v.name << ", " << layout_bytes(*v.fields) << " bytes:\n";
+        print_layout(*v.fields, line);
+        vector<string> shared = false_sharing_report(*v.fields, threads, line);
+        for (const string& s : shared) cout << "  " << s << "\n";
+
+        TraceScope scope(v.name, "point");
+        string point = string(v.name) + " bytes=" + to_string(layout_bytes(*v.fields)) +
+                       " threads=" + to_string(threads) + " line=" + to_string(line);
+        vector<double> rates = checkpointed(point, threads, [&] {
+            vector<vector<double>> reps;
+            for (int r = 0; r < 3; r++) reps.push_back(run_layout(*v.fields, threads, cpus));
+            vector<double> medians;
+            for (int t = 0; t < threads; t++) {
+                vector<double> per;
+                for (auto& rep : reps) per.push_back(rep[t]);
+                medians.push_back(median_of_vector(per));
+            }
+            return medians;
+        });
+        double total = 0;
+        cout << "  Thread  Maccess/s\n";
+        for (int t = 0; t < threads; t++) {
+            double m = rates[t];
+            total += m;
+            cout << setw(8) << t << fixed << setprecision(1) << setw(11) << m / 1e6 << "\n";
+        }
+        cout << "  Total   " << setw(10) << total / 1e6 << "\n";
+        totals.push_back(total);
+        record_metric("layout_accesses_per_second", "Field accesses per second for a struct layout",
+                      {{"layout", v.name}}, total);
+    }
+    cout << "\nPadded vs as given: " << fixed << setprecision(2) << totals[1] / totals[0] << "x, "
+         << layout_bytes(padded) << " vs " << layout_bytes(fields) << " bytes\n";
+    record_metric("layout_padding_speedup_ratio", "Accesses per second of the padded layout over the given one",
+                  {}, totals[1] / totals[0]);
+    return 0;
+}
+
+// Bandwidth fairness and latency QoS under contention
+
+const double FAIR_INTERVAL_S = 0.25;         // Length of one time-series interval
+const size_t FAIR_CHUNK = 64 * 1024;         // Batch threads stream in chunks of this size
+
+struct FairThread {
+    int cpu;
+    double intensity;         // Share of time a batch thread streams; 0: latency thread
+    vector<double> series;    // Per interval: GB/s (batch) or ns per hop (latency)
+};
+
+double jain_index(const vector<double>& x) {
+    double sum = 0, sq = 0;
+    for (double v : x) {
+        sum += v;
+        sq += v * v;
+    }
+    return sq > 0 ? sum * sum / (x.size() * sq) : 1;
+}
+
+int run_fairness_probe(int batch_threads, int duration_s) {
+    cout << "=== Bandwidth fairness and latency QoS ===\n";
+    vector<int> cpus = available_cpus();
+    if (batch_threads <= 0) batch_threads = max<int>(1, cpus.size() - 1);
+    if (duration_s <= 0) duration_s = 5;
+    size_t intervals = max<size_t>(1, (size_t)(duration_s / FAIR_INTERVAL_S));
+
+    // Thread 0 is latency-sensitive, the rest are batch at 100%, 50%, 25%, ...
+    const double intensities[] = {1.0, 0.5, 0.25};
+    vector<FairThread> ft;
+    ft.push_back({cpus[0], 0, {}});
+    for (int b = 0; b < batch_threads; b++)
+        ft.push_back({cpus[(1 + b) % cpus.size()], intensities[b % 3], {}});
+    int n = (int)ft.size();
+    if ((int)cpus.size() < n)
+        cout << "warning: " << n << " threads on " << cpus.size() << " CPUs, threads share cores\n";
+
+    size_t lat_ws = reported_cache_size(3) / 2;
+    size_t batch_ws = reported_cache_size(3) * 2;
+    void** chain = (void**)allocate_aligned(PAGE_SIZE, lat_ws);
+    create_random_chain(chain, lat_ws / sizeof(void*));
+    vector<char*> bufs(n, nullptr);
+    for (int t = 1; t < n; t++) {
+        bufs[t] = (char*)allocate_aligned(PAGE_SIZE, batch_ws);
+        memset(bufs[t], 1, batch_ws);
+    }
+
+    // Latency thread alone first
+    vector<int> thread_cpus;
+    for (auto& f : ft) thread_cpus.push_back(f.cpu);
+    double alone = checkpointed("alone cpu=" + to_string(ft[0].cpu), 1, [&] {
+        pin_thread_to_cpu(ft[0].cpu);
+        warmup_chain(chain, lat_ws / sizeof(void*));
+        vector<double> alone_samples;
+        for (int r = 0; r < 5; r++)
+            alone_samples.push_back(measure_chain_latency(chain, lat_ws / sizeof(void*), 200'000));
+        return vector<double>{median_of_vector(alone_samples)};
+    })[0];
+    cout << "Latency thread: " << lat_ws / 1024 << " KB chain, " << fixed << setprecision(1)
+         << alone << " ns per hop alone\n";
+    cout << "Batch threads: " << batch_ws / (1024 * 1024) << " MB each, " << duration_s << " s, "
+         << FAIR_INTERVAL_S * 1000 << " ms intervals\n\n";
+
+    // One checkpoint point for the whole contended run: every thread's series
+    string point = "contended cpus=" + cpu_list_string(thread_cpus) + " intervals=" + to_string(intervals);
+    vector<double> series = checkpointed(point, n * intervals, [&] {
+        auto start_time = steady_clock::now() + milliseconds(50);
+        run_pinned_threads(n, thread_cpus, [&](int t) {
+            FairThread& me = ft[t];
+            me.series.assign(intervals, 0);
+            vector<double> work(intervals, 0), busy(intervals, 0);
+            this_thread::sleep_until(start_time);
+            auto end = start_time + duration<double>(intervals * FAIR_INTERVAL_S);
+
+            void** p = chain;
+            size_t off = 0;
+            uint64_t sum = 0;
+            for (auto now = steady_clock::now(); now < end; now = steady_clock::now()) {
+                size_t slot = min(intervals - 1,
+                                  (size_t)(duration_cast<duration<double>>(now - start_time).count() / FAIR_INTERVAL_S));
+                if (t == 0) {
+                    for (int i = 0; i < 1000; i++) p = (void**)*p;
+                    busy[slot] += duration_cast<duration<double, nano>>(steady_clock::now() - now).count();
+                    work[slot] += 1000;
+                } else {
+                    const uint64_t* w = (const uint64_t*)(bufs[t] + off);
+                    for (size_t i = 0; i < FAIR_CHUNK / 8; i++) sum += w[i];
+                    off = (off + FAIR_CHUNK) % batch_ws;
+                    work[slot] += FAIR_CHUNK;
+                    // Idle for the rest of the duty cycle
+                    auto done = steady_clock::now();
+                    auto idle_until = done + (done - now) * (1 / me.intensity - 1);
+                    while (steady_clock::now() < idle_until) {}
+                }
+            }
+            for (size_t i = 0; i < intervals; i++)
+                me.series[i] = t == 0 ? (work[i] ? busy[i] / work[i] : 0) : work[i] / FAIR_INTERVAL_S;
+            blackhole_ptr(p);
+            blackhole(sum);
+        });
+        vector<double> all;
+        for (auto& f : ft) all.insert(all.end(), f.series.begin(), f.series.end());
+        return all;
+    });
+    for (int t = 0; t < n; t++)
+        ft[t].series.assign(series.begin() + t * intervals, series.begin() + (t + 1) * intervals);
+
+    // Time series, then per-thread summary
+    cout << "  time_s   lat ns";
+    for (int t = 1; t < n; t++) cout << setw(9) << "t" + to_string(t) + " GB/s";
+    cout << "\n";
+    for (size_t i = 0; i < intervals; i++) {
+        double lat = ft[0].series[i];
+        cout << setw(8) << setprecision(2) << (i + 1) * FAIR_INTERVAL_S << setw(9) << setprecision(1) << lat;
+        for (int t = 1; t < n; t++) cout << setw(9) << ft[t].series[i] / 1e9;
+        if (lat > 3 * alone) cout << "  <- latency thread starved";
+        cout << "\n";
+        trace_counter("latency thread ns", lat);
+    }
+
+    cout << "\nThread  CPU  Class     Role                 mean      min      max\n";
+    vector<double> normalized;
+    for (int t = 0; t < n; t++) {
+        const FairThread& f = ft[t];
+        vector<double> s = f.series;
+        double mean = 0;
+        for (double v : s) mean += v;
+        mean /= s.size();
+        double scale = t == 0 ? 1 : 1e9;
+        string role = t == 0 ? "latency ns" : "batch " + to_string((int)(f.intensity * 100)) + "% GB/s";
+        cout << setw(6) << t << setw(5) << f.cpu << "  " << left << setw(10) << cpu_class(f.cpu)
+             << setw(17) << role << right << setprecision(1) << setw(9) << mean / scale
+             << setw(9) << *min_element(s.begin(), s.end()) / scale
+             << setw(9) << *max_element(s.begin(), s.end()) / scale << "\n";
+        if (t > 0) normalized.push_back(mean / f.intensity);
+        record_metric(t == 0 ? "qos_latency_ns" : "qos_bandwidth_bytes_per_second",
+                      t == 0 ? "Latency-sensitive thread ns per hop under contention"
+                             : "Batch thread bandwidth under contention",
+                      {{"thread", to_string(t)}, {"cpu", to_string(f.cpu)}}, mean);
+    }
+
+    // Fairness of batch bandwidth per unit of demanded intensity; starvation of thread 0
+    double lat_median = median_of_vector(ft[0].series);
+    double lat_worst = *max_element(ft[0].series.begin(), ft[0].series.end());
+    cout << "\nJain fairness (batch bandwidth / intensity): " << setprecision(3)
+         << (normalized.empty() ? 1.0 : jain_index(normalized)) << "\n";
+    cout << "Latency thread: median " << setprecision(2) << lat_median / alone << "x, worst interval "
+         << lat_worst / alone << "x of alone";
+    if (lat_median > 2 * alone || lat_worst > 3 * alone) cout << "  ** STARVED **";
+    cout << "\n";
+    record_metric("qos_jain_fairness_ratio", "Jain index of batch bandwidth per unit of intensity", {},
+                  normalized.empty() ? 1.0 : jain_index(normalized));
+    record_metric("qos_latency_slowdown_ratio", "Latency thread median slowdown vs running alone", {},
+                  lat_median / alone);
+
+    free(chain);
+    for (char* b : bufs) free(b);
+    return 0;
+}
+
+// Estimated cost of one probe run, used by the planner
+struct ProbeCost {
+    double seconds = 0;
+    size_t bytes = 0;         // Peak memory
+    int duration_arg = -1;    // Argument that sets the run time, if the probe has one
+};
+
+// Planner cost model: rough per-level access costs, chain points follow the
+// runner's budget so they scale with the calibrated sample length
+const double PLAN_SETUP_NS_PER_BYTE = 0.5;   // Fill and link a buffer
+const double PLAN_MARGIN = 1.15;             // Head room on every estimate
+
+double plan_access_ns(size_t bytes) {
+    string level = level_for_footprint(bytes);
+    if (level == "L1") return 1;
+    if (level == "L2") return 4;
+    if (level == "L3") return 20;
+    return 100;
+}
+
+// One measure_pattern point: setup, warm-up, pilot and timed samples
+double plan_chain_point(size_t bytes, int repeats = MEASURE_REPEATS, double access_ns = 0) {
+    if (access_ns == 0) access_ns = plan_access_ns(bytes);
+    double sample_s = min(runner_calibration().sample_ns, ITERATIONS * access_ns) * 1e-9;
+    double hops = bytes / 8.0 + RUNNER_MIN_ITERATIONS;
+    return bytes * PLAN_SETUP_NS_PER_BYTE * 1e-9 + hops * access_ns * 1e-9 + repeats * sample_s;
+}
+
+double plan_l1_detection() {
+    double s = 7 * plan_chain_point(256 * 1024 * sizeof(void*), MEASURE_REPEATS, 2);
+    for (size_t kb : {4, 8, 12, 16, 20, 24, 28, 32, 36, 40, 48, 56, 64, 80, 96, 112, 128})
+        s += plan_chain_point(kb * 1024);
+    s += 20 * plan_chain_point(64 * 1024, MEASURE_REPEATS, 2);
+    return s + BUFFER_SIZE * PLAN_SETUP_NS_PER_BYTE * 1e-9;
+}
+
+// Levels the multi-level probes sweep: half of L1, L2, L3 and 4x L3
+vector<size_t> plan_level_sizes() {
+    return {reported_cache_size(1) / 2, reported_cache_size(2) / 2,
+            reported_cache_size(3) / 2, reported_cache_size(3) * 4};
+}
+
+struct ProbeArgs {
+    vector<string> values;
+
+    int get_int(size_t i, int def = 0) const {
+        return i < values.size() ? atoi(values[i].c_str()) : def;
+    }
+    double get_double(size_t i, double def = 0) const {
+        return i < values.size() ? atof(values[i].c_str()) : def;
+    }
+    string get_string(size_t i, const string& def = "") const {
+        return i < values.size() ? values[i] : def;
+    }
+};
+
+struct ProbeInfo {
+    string name;
+    string args;
+    string help;
+    function<int(const ProbeArgs&)> run;
+    function<ProbeCost(const ProbeArgs&)> estimate;
+    bool manual = false;    // Reads input, writes side files or never ends: not in the default plan
+};
+
+int run_plan(const ProbeArgs& a);
+
+// Probe registry.
+// Each probe is a name, a usage line and an entry point taking its
+// positional arguments; main, usage and dispatch all come from this table.
+const vector<ProbeInfo>& probe_registry() {
+    static const vector<ProbeInfo> probes = {
+        {"l1", "", "detect L1 line size, capacity and associativity (default)",
+         [](const ProbeArgs&) { return run_l1_detection(); },
+         [](const ProbeArgs&) { return ProbeCost{plan_l1_detection(), BUFFER_SIZE}; }},
+        {"histogram", "[threads]", "scatter-update throughput by bin count",
+         [](const ProbeArgs& a) { return run_histogram_probe(a.get_int(0)); },
+         [](const ProbeArgs& a) {
+             int threads = a.get_int(0) > 0 ? a.get_int(0) : (int)available_cpus().size();
+             ProbeCost c{0, 0};
+             for (size_t bins = 16; bins <= (1u << 24); bins *= 4)
+                 for (int t : thread_count_sweep(threads)) {
+                     c.seconds += 3 * 5 * (HIST_KEYS * 3e-9 + bins * 4 * t * PLAN_SETUP_NS_PER_BYTE * 1e-9);
+                     for (HistStrategy st : {HistStrategy::Shared, HistStrategy::Private,
+                                             HistStrategy::MultiCopy})
+                         if (histogram_bytes(st, bins, t) <= HIST_MAX_BYTES)
+                             c.bytes = max(c.bytes, histogram_bytes(st, bins, t));
+                 }
+             c.bytes += HIST_KEYS * sizeof(uint32_t);
+             return c;
+         }},
+        {"bloom", "[line_size]", "Bloom filter lookup cost and FPR by filter size",
+         [](const ProbeArgs& a) { return run_bloom_probe(a.get_int(0)); },
+         [](const ProbeArgs&) {
+             double s = 0;
+             for (size_t bytes = 1; bytes <= 2 * reported_cache_size(3); bytes *= 2)
+                 s += 3 * (bytes * 8 / BLOOM_BITS_PER_KEY * 20e-9 +
+                           3 * BLOOM_QUERIES * 4 * plan_access_ns(bytes) * 1e-9);
+             return ProbeCost{s, 2 * reported_cache_size(3) + BLOOM_QUERIES * 8};
+         }},
+        {"linemap", "[ws_kb]", "per-line latency map by address and set",
+         [](const ProbeArgs& a) { return run_linemap_probe(a.get_int(0)); },
+         [](const ProbeArgs& a) {
+             size_t ws = a.get_int(0) > 0 ? a.get_int(0) * 1024ull : reported_cache_size(1);
+             return ProbeCost{200.0 * ws / reported_line_size() * plan_access_ns(ws) * 1e-9, ws};
+         }},
+        {"coherence", "[cpu]", "snoop filter capacity (reader on cpu)",
+         [](const ProbeArgs& a) { return run_coherence_probe(a.get_int(0, -1)); },
+         [](const ProbeArgs&) {
+             double s = 0;
+             for (size_t bytes = 16 * 1024; bytes <= reported_cache_size(3); bytes *= 2) {
+                 size_t lines = bytes / reported_line_size();
+                 s += 2 * max<size_t>(5, 65536 / lines) * lines * 4 * plan_access_ns(bytes) * 1e-9;
+             }
+             return ProbeCost{s, reported_cache_size(3)};
+         }},
+        {"paging", "", "paging-structure cache hit/miss walk cost",
+         [](const ProbeArgs&) { return run_paging_probe(); },
+         [](const ProbeArgs&) {
+             double s = 0;
+             for (size_t points : {16, 64, 512, 2048, 8192})
+                 s += 4 * plan_chain_point(points * sizeof(void*), 3, 100);
+             return ProbeCost{s, 4 * 8192 * PAGE_SIZE};
+         }},
+        {"disambiguation", "", "store/load alias speculation benefit and cost",
+         [](const ProbeArgs&) { return run_disambiguation_probe(); },
+         [](const ProbeArgs&) { return ProbeCost{9 * 3 * 5 * ALIAS_ITERS * 4e-9, ALIAS_TABLE * 16}; }},
+        {"addressing", "", "L1/L2 load-to-use latency per addressing mode",
+         [](const ProbeArgs&) { return run_addressing_probe(); },
+         [](const ProbeArgs&) {
+             double s = 0;
+             for (size_t bytes : {reported_cache_size(1) / 2, reported_cache_size(2) / 2})
+                 s += 5 * (MEASURE_REPEATS / 2) * 4e6 * plan_access_ns(bytes) * 1e-9;
+             return ProbeCost{s, reported_cache_size(2) / 2};
+         }},
+        {"branch", "", "BTB, conditional and indirect predictor capacity",
+         [](const ProbeArgs&) { return run_branch_probe(); },
+         [](const ProbeArgs&) { return ProbeCost{(33 + 10 + 10) * 4e6 * 5e-9, 16384 * 64 * 4}; }},
+        {"virt", "[baseline_ns]", "hypervisor detection and nested page-walk overhead",
+         [](const ProbeArgs& a) { return run_virtualization_probe(a.get_double(0)); },
+         [](const ProbeArgs&) {
+             return ProbeCost{3 * plan_chain_point(16384 * sizeof(void*), MEASURE_REPEATS, 100),
+                              2 * 16384 * PAGE_SIZE};
+         }},
+        {"soak", "[secs] [levels]", "latency time series, levels e.g. L1,L2,L3,DRAM",
+         [](const ProbeArgs& a) { return run_soak_probe(a.get_int(0), a.get_string(1)); },
+         [](const ProbeArgs& a) {
+             ProbeCost c{(double)(a.get_int(0) > 0 ? a.get_int(0) : 60), 0, 0};
+             for (size_t bytes : plan_level_sizes()) c.bytes += bytes;
+             return c;
+         },
+         true},
+        {"publish", "", "detect and publish the topology to shared memory",
+         [](const ProbeArgs&) { return run_publish_probe(); },
+         [](const ProbeArgs&) {
+             double s = plan_l1_detection();
+             for (int level = 1; level <= 3; level++) s += plan_chain_point(reported_cache_size(level) / 2, 5);
+             return ProbeCost{s, max(BUFFER_SIZE, reported_cache_size(3) / 2)};
+         },
+         true},
+        {"topology", "", "print the published topology (cache_topology.h reader)",
+         [](const ProbeArgs&) { return run_topology_reader(); },
+         [](const ProbeArgs&) { return ProbeCost{}; },
+         true},
+        {"allocator", "[node_bytes]", "list traversal cost by allocator layout",
+         [](const ProbeArgs& a) { return run_allocator_probe(a.get_int(0)); },
+         [](const ProbeArgs& a) {
+             size_t node_bytes = a.get_int(0) >= (int)sizeof(AllocNode) ? a.get_int(0) : 32;
+             ProbeCost c{0, 0};
+             for (size_t bytes : plan_level_sizes()) {
+                 size_t count = max<size_t>(16, bytes / node_bytes);
+                 c.seconds += 5 * (plan_chain_point(bytes, 7) + count * 100e-9);
+                 c.bytes = max(c.bytes, alloc_list_peak_bytes(count, node_bytes));
+             }
+             return c;
+         }},
+        {"linefraction", "[every_nth]", "useful bandwidth by bytes used per line",
+         [](const ProbeArgs& a) { return run_line_fraction_probe(a.get_int(0)); },
+         [](const ProbeArgs&) {
+             return ProbeCost{4 * 5 * 6 * runner_calibration().sample_ns * 1e-9, plan_level_sizes().back()};
+         }},
+        {"clocks", "", "timestamp source cost, resolution and cost next to a miss",
+         [](const ProbeArgs&) { return run_clock_probe(); },
+         [](const ProbeArgs&) {
+             // 21 sources: call loop, resolution search, chase with and without reads
+             return ProbeCost{21 * (0.2 + 10 * 200'000 * 100e-9 + 0.1), reported_cache_size(3) * 4};
+         }},
+        {"sparse", "[max_gb] [pool_mb]", "page-spread chains over a large range, memfd-aliased",
+         [](const ProbeArgs& a) { return run_sparse_probe(a.get_int(0), a.get_int(1)); },
+         [](const ProbeArgs& a) {
+             size_t pool = (a.get_int(1) > 0 ? a.get_int(1) : 64) * (1ull << 20);
+             size_t max_span = (a.get_int(0) > 0 ? a.get_int(0) : 4) * (1ull << 30);
+             double s = 0;
+             for (size_t span = pool; span <= max_span; span *= 2)
+                 s += 2 * plan_chain_point(span / PAGE_SIZE * sizeof(void*), 5, 100);
+             return ProbeCost{s, pool + min(available_memory_bytes() / 2, max_span)};
+         }},
+        {"rwmix", "", "bandwidth by read:write ratio per level, 1 and all cores",
+         [](const ProbeArgs&) { return run_rw_mix_probe(); },
+         [](const ProbeArgs&) {
+             double s = 4 * 5 * (available_cpus().size() > 1 ? 2 : 1) *
+                        (6 * runner_calibration().sample_ns * 1e-9);
+             return ProbeCost{s, plan_level_sizes().back()};
+         }},
+        {"placement", "[threads] [chase|stream] [ws_kb]", "compare thread placements, recommend a mask",
+         [](const ProbeArgs& a) {
+             return run_placement_probe(a.get_int(0), a.get_string(1, "chase"), a.get_int(2));
+         },
+         [](const ProbeArgs& a) {
+             size_t cpus = available_cpus().size();
+             size_t threads = a.get_int(0) > 0 ? a.get_int(0) : max<size_t>(1, cpus / 2);
+             size_t ws = a.get_int(2) > 0 ? a.get_int(2) * 1024ull : reported_cache_size(3);
+             double setup = threads * ws * PLAN_SETUP_NS_PER_BYTE * 1e-9 / min(threads, cpus);
+             return ProbeCost{5 * 3 * (PLACE_RUN_SECONDS + setup), threads * ws};
+         }},
+        {"export", "[file.xml|file.json]", "hwloc-style topology with measured caches and distances",
+         [](const ProbeArgs& a) { return run_export_probe(a.get_string(0, "topology.xml")); },
+         [](const ProbeArgs&) {
+             size_t cores = available_cpus().size();
+             double s = plan_l1_detection();
+             for (int level = 1; level <= 3; level++) s += plan_chain_point(reported_cache_size(level) / 2, 5);
+             return ProbeCost{s + cores * (cores - 1) / 2 * 5000 * 400e-9,
+                              max(BUFFER_SIZE, reported_cache_size(3) / 2)};
+         },
+         true},
+        {"layout", "[file|-] [threads]", "false sharing of a described struct, as given and padded",
+         [](const ProbeArgs& a) { return run_layout_probe(a.get_string(0), a.get_int(1)); },
+         [](const ProbeArgs&) {
+             return ProbeCost{7 * plan_chain_point(256 * 1024 * sizeof(void*), MEASURE_REPEATS, 2) + 2 * 3 * 0.3,
+                              256 * 1024 * sizeof(void*)};
+         },
+         true},
+        {"fairness", "[batch_threads] [secs]", "per-thread bandwidth and latency QoS under contention",
+         [](const ProbeArgs& a) { return run_fairness_probe(a.get_int(0), a.get_int(1)); },
+         [](const ProbeArgs& a) {
+             size_t batch = a.get_int(0) > 0 ? a.get_int(0) : max<size_t>(1, available_cpus().size() - 1);
+             ProbeCost c{(double)(a.get_int(1) > 0 ? a.get_int(1) : 5) + 1,
+                         reported_cache_size(3) / 2 + batch * reported_cache_size(3) * 2, 1};
+             c.seconds += c.bytes * PLAN_SETUP_NS_PER_BYTE * 1e-9;
+             return c;
+         }},
+        {"plan", "[deadline_s] [run] [probe[:args]...]", "estimate time and memory, fit a deadline",
+         [](const ProbeArgs& a) { return run_plan(a); },
+         [](const ProbeArgs&) { return ProbeCost{}; },
+         true},
+    };
+    return probes;
+}
+
+const ProbeInfo* find_probe(const string& name) {
+    for (auto& p : probe_registry())
+        if (p.name == name) return &p;
+    return nullptr;
+}
+
+struct PlanItem {
+    const ProbeInfo* probe;
+    ProbeArgs args;
+    ProbeCost cost;
+    bool selected = false;
+    string note;
+};
+
+// Estimate the requested probes and fit them into a deadline: probes are
+// admitted in the order given (the priority), a probe with a duration
+// argument is shortened to the time left, and the admitted ones run
+// shortest first so an overrun loses as few probes as possible
+int run_plan(const ProbeArgs& a) {
+    double deadline = a.get_double(0);
+    size_t first = 1;
+    bool execute = a.get_string(1) == "run";
+    if (execute) first = 2;
+
+    vector<PlanItem> items;
+    if (a.values.size() > first) {
+        for (size_t i = first; i < a.values.size(); i++) {
+            stringstream ss(a.values[i]);
+            string name, arg;
+            getline(ss, name, ':');
+            const ProbeInfo* p = find_probe(name);
+            if (!p || p->name == "plan") {
+                cout << "Unknown probe '" << name << "'\n";
+                return 1;
+            }
+            PlanItem item{p, {}, {}, false, ""};
+            while (getline(ss, arg, ':')) item.args.values.push_back(arg);
+            items.push_back(item);
+        }
+    } else {
+        // Default sweep: every probe that ends on its own without input or side files
+        for (const ProbeInfo& p : probe_registry())
+            if (!p.manual)
+                items.push_back({&p, {}, {}, false, ""});
+    }
+
+    size_t memory = available_memory_bytes();
+    double remaining = deadline > 0 ? deadline : 1e18;
+
+    for (PlanItem& it : items) {
+        it.cost = it.probe->estimate(it.args);
+        double need = it.cost.seconds * PLAN_MARGIN;
+        if (it.cost.bytes > memory) {
+            it.note = "needs more memory than available";
+        } else if (need <= remaining) {
+            it.selected = true;
+        } else if (it.cost.duration_arg >= 0 && remaining / PLAN_MARGIN >= 10) {
+            int secs = (int)(remaining / PLAN_MARGIN);
+            it.args.values.resize(max<size_t>(it.args.values.size(), it.cost.duration_arg + 1));
+            it.args.values[it.cost.duration_arg] = to_string(secs);
+            it.cost = it.probe->estimate(it.args);
+            it.selected = true;
+            it.note = "shortened to " + to_string(secs) + " s";
+        } else {
+            it.note = "does not fit the deadline";
+        }
+        if (it.selected) remaining -= it.cost.seconds * PLAN_MARGIN;
+    }
+    stable_sort(items.begin(), items.end(), [](const PlanItem& x, const PlanItem& y) {
+        if (x.selected != y.selected) return x.selected;
+        return x.selected && x.cost.seconds < y.cost.seconds;
+    });
+
+    cout << "=== Run plan ===\n";
+    cout << "Deadline: " << (deadline > 0 ? to_string((int)deadline) + " s" : string("none"))
+         << ", sample " << fixed << setprecision(1) << runner_calibration().sample_ns / 1e6
+         << " ms, margin " << setprecision(0) << (PLAN_MARGIN - 1) * 100 << "%, "
+         << available_cpus().size() << " CPUs, " << memory / (1024 * 1024) << " MB available\n";
+    cout << "  #  Probe                      Est. s   Peak MB  Status\n";
+    double total = 0;
+    size_t peak = 0;
+    int n = 0;
+    for (const PlanItem& it : items) {
+        string head = it.probe->name;
+        for (const string& v : it.args.values) head += ":" + v;
+        cout << setw(3) << (it.selected ? to_string(++n) : "-") << "  " << left << setw(24) << head
+             << right << setprecision(1) << setw(9) << it.cost.seconds
+             << setw(10) << it.cost.bytes / (1024 * 1024) << "  "
+             << (it.selected ? "run" : "skip") << (it.note.empty() ? "" : ", " + it.note) << "\n";
+        record_metric("plan_estimate_seconds", "Estimated probe run time",
+                      {{"planned", it.probe->name}}, it.cost.seconds);
+        if (it.selected) {
+            total += it.cost.seconds;
+            peak = max(peak, it.cost.bytes);
+        }
+    }
+    cout << "Planned: " << setprecision(1) << total << " s estimated, "
+         << setprecision(1) << total * PLAN_MARGIN << " s with margin, peak "
+         << peak / (1024 * 1024) << " MB\n";
+    if (!execute) return 0;
+
+    // Run the plan; re-check the real time left before each probe
+    auto start = steady_clock::now();
+    int rc = 0;
+    for (const PlanItem& it : items) {
+        if (!it.selected) continue;
+        double elapsed = duration_cast<duration<double>>(steady_clock::now() - start).count();
+        if (deadline > 0 && elapsed + it.cost.seconds * PLAN_MARGIN > deadline) {
+            cout << "\nSkipping " << it.probe->name << ": " << setprecision(1)
+                 << deadline - elapsed << " s left\n";
+            continue;
+        }
+
+        // Calibration and earlier probes pin the process; start each probe unpinned
+        runner_release();
+        cout << "\n";
+        CURRENT_PROBE = it.probe->name;
+        CHECKPOINT_RUN = it.probe->name;
+        for (const string& v : it.args.values) CHECKPOINT_RUN += " " + v;
+        double probe_start = trace_now_us();
+        auto t0 = steady_clock::now();
+        rc |= it.probe->run(it.args);
+        double took = duration_cast<duration<double>>(steady_clock::now() - t0).count();
+        trace_complete(it.probe->name, "phase", probe_start);
+
+        cout << "[plan] " << it.probe->name << ": " << setprecision(1) << took
+             << " s, estimated " << it.cost.seconds << " s\n";
+        record_metric("plan_actual_seconds", "Measured probe run time",
+                      {{"probe", "plan"}, {"planned", it.probe->name}}, took);
+    }
+    CURRENT_PROBE = "plan";
+    return rc;
+}
+
+void print_usage(const char* prog) {
+    cout << "Usage: " << prog << " [--cpu N] [--trace FILE] [--metrics FILE]\n"
+         << "       [--results FILE [--resume]] [mode] [args]\n";
+    for (auto& p : probe_registry()) {
+        string head = p.name + (p.args.empty() ? "" : " " + p.args);
+        cout << "  " << left << setw(23) << head << ' ' << right << p.help << "\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    ios::sync_with_stdio(false);
+    cin.tie(nullptr);
+
+    vector<string> args(argv + 1, argv + argc);
+
+    // Global options come before the mode
+    string trace_path;
+    bool resume = false;
+    while (!args.empty()) {
+        if (args[0] == "--resume") {
+            resume = true;
+            args.erase(args.begin());
+            continue;
+        }
+        if (args.size() < 2 || (args[0] != "--cpu" && args[0] != "--trace" &&
+                                args[0] != "--metrics" && args[0] != "--results")) break;
+        if (args[0] == "--cpu") RUNNER_CPU = atoi(args[1].c_str());
+        else if (args[0] == "--trace") trace_path = args[1];
+        else if (args[0] == "--results") RESULTS_PATH = args[1];
+        else METRICS_PATH = args[1];
+        args.erase(args.begin(), args.begin() + 2);
+    }
+    if (resume && RESULTS_PATH.empty()) {
+        cout << "--resume needs --results FILE\n";
+        return 1;
+    }
+    TRACE_ENABLED = !trace_path.empty();
+    trace_thread_name("main");
+
+    string mode = args.empty() ? "l1" : args[0];
+    if (mode == "help" || mode == "--help") {
+        print_usage(argv[0]);
+        return 0;
+    }
+
+    const ProbeInfo* probe = find_probe(mode);
+    if (!probe) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    CURRENT_PROBE = probe->name;
+    HostEnvironment env = detect_host_environment();
+    print_host_environment(env);
+
+    ProbeArgs pa;
+    if (!args.empty()) pa.values.assign(args.begin() + 1, args.end());
+
+    CHECKPOINT_RUN = probe->name;
+    for (const string& v : pa.values) CHECKPOINT_RUN += " " + v;
+    if (!RESULTS_PATH.empty() && !open_results(environment_fingerprint(env), resume)) return 2;
+    double run_start = trace_now_us();
+    int rc = probe->run(pa);
+    trace_complete(probe->name, "phase", run_start);
+
+    print_steal_since(env);
+    if (!METRICS_PATH.empty()) {
+        if (write_metrics()) cout << "Metrics written to " << METRICS_PATH << "\n";
+        else cout << "Could not write metrics to " << METRICS_PATH << "\n";
+    }
+    if (TRACE_ENABLED) {
+        if (write_trace(trace_path)) cout << "Trace written to " << trace_path << "\n";
+        else cout << "Could not write trace to " << trace_path << "\n";
+    }
+    return rc;
 }
@@ -0,0 +1,83 @@
+// Header-only reader for the cache topology published by
+// `cache_analyzer publish` into POSIX shared memory (/dev/shm).
+//
+// The segment is one page: a fixed header guarded by a sequence lock and a
+// small array of cache levels. The publisher makes the sequence odd while
+// it writes; readers copy the page and retry if the sequence was odd or
+// changed under them. Readers map the segment read-only.
+//
+//     cache_topology t;
+//     if (cache_topology_read(&t)) use(t.levels[0].line_size);
+//
+// Works from C and C++ (GCC/Clang atomics builtins).
+#ifndef CACHE_TOPOLOGY_H
+#define CACHE_TOPOLOGY_H
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CACHE_TOPOLOGY_SHM_NAME  "/cache_analyzer_topology"
+#define CACHE_TOPOLOGY_MAGIC     0x4f504f5448434143ULL   /* "CACHTOPO" */
+#define CACHE_TOPOLOGY_VERSION   1
+#define CACHE_TOPOLOGY_MAX_LEVELS 4
+
+/* Flags of a cache level */
+#define CACHE_TOPOLOGY_MEASURED  1u   /* size/line/ways measured, not just reported */
+
+typedef struct cache_topology_level {
+    uint32_t level;            /* 1, 2, 3, ... */
+    uint32_t flags;
+    uint64_t size_bytes;
+    uint32_t line_size;
+    uint32_t ways;
+    double   latency_ns;       /* Pointer-chase latency at half the capacity */
+} cache_topology_level;
+
+typedef struct cache_topology {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t struct_size;      /* sizeof(cache_topology) of the publisher */
+    uint64_t seq;              /* Sequence lock, odd while being written */
+    uint64_t published_unix_ns;
+    uint32_t virtualized;      /* Hypervisor detected */
+    uint32_t num_levels;
+    cache_topology_level levels[CACHE_TOPOLOGY_MAX_LEVELS];
+} cache_topology;
+
+/* Copy a consistent snapshot into *out; returns 0 if nothing valid is published */
+static inline int cache_topology_read(cache_topology* out) {
+    int fd = shm_open(CACHE_TOPOLOGY_SHM_NAME, O_RDONLY, 0);
+    if (fd < 0) return 0;
+    /* The publisher sizes the segment after creating it; mapping it before
+       that would fault (SIGBUS) on the first load */
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(cache_topology)) {
+        close(fd);
+        return 0;
+    }
+    void* map = mmap(NULL, sizeof(cache_topology), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 0;
+
+    const cache_topology* shm = (const cache_topology*)map;
+    int ok = 0;
+    for (int attempt = 0; attempt < 1000; attempt++) {
+        uint64_t s1 = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1) continue;
+        memcpy(out, shm, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        uint64_t s2 = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+        if (s1 == s2) { ok = 1; break; }
+    }
+    munmap(map, sizeof(cache_topology));
+
+    return ok && out->magic == CACHE_TOPOLOGY_MAGIC
+              && out->version == CACHE_TOPOLOGY_VERSION
+              && out->struct_size == sizeof(cache_topology);
+}
+
+#endif